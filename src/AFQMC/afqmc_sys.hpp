@@ -29,6 +29,13 @@
 #include "AFQMC/energy.hpp"
 #include "AFQMC/vHS.hpp"
 #include "AFQMC/mixed_density_matrix.hpp"
+#include "AFQMC/orthogonalize.hpp"
+#include "AFQMC/fixed_size_kernels.hpp"
+#include "Utilities/Clock.h"
+#include "Utilities/cache_info.hpp"
+#include "Message/OpenMP.h"
+#include "Utilities/ScratchArena.h"
+#include "Matrix/PlanarMatrix.hpp"
 
 namespace qmcplusplus
 {
@@ -37,7 +44,9 @@ namespace base
 {
 
 /**
- * Quasi-global AFQMC object, contains workspaces 
+ * Quasi-global AFQMC object, contains the trial wave function.
+ * Kernels take their scratch space from the arena of the calling thread (ScratchArena),
+ * so they can be called concurrently on different walker sets.
  * 
  * \todo get rid of it and global state in general
  */
@@ -62,55 +71,117 @@ struct afqmc_sys: public AFQMCInfo
       NMO = nmo_;
       NAEA = NAEB = na;
 
-      TMat_NM.resize(extents[NAEA][NMO]);
-      TMat_MN.resize(extents[NMO][NAEA]);
-      TMat_NN.resize(extents[NAEA][NAEA]);
-      TMat_MM.resize(extents[NMO][NMO]); 
-      TMat_MM2.resize(extents[NMO][NMO]); 
-
-      // reserve enough space in lapack's work array
-      // Make sure it is large enough for:
-      //  1. getri( TMat_NN )
-      WORK.reserve(  ma::getri_optimal_workspace_size(TMat_NN) );
-      //  2. geqrf( TMat_NM )
-      WORK.reserve(  ma::geqrf_optimal_workspace_size(TMat_NM) );
-      //  3. gqr( TMat_NM )
-      WORK.reserve(  ma::gqr_optimal_workspace_size(TMat_NM) );
-      //  4. gelqf( TMat_MN )
-      WORK.reserve(  ma::gelqf_optimal_workspace_size(TMat_MN) );
-      //  5. glq( TMat_MN )
-      WORK.reserve(  ma::glq_optimal_workspace_size(TMat_MN) );
-
-      // IWORK: integer buffer for getri/getrf  
-      IWORK.resize(NMO);
-
-      // TAU: ComplexVector used in QR routines 
-      TAU.resize(extents[NMO]);
-
-      // temporary storage for contraction of density matrix with 2-electron integrals  
-      Gcloc.resize(extents[1][1]); // force resize later 
+      // size of lapack's work array, large enough for:
+      //  1. getri( [NAEA][NAEA] )
+      //  2. gelqf( [NMO][NAEA] )
+      //  3. glq( [NMO][NAEA] )
+      ComplexMatrix NN(extents[NAEA][NAEA]), MN(extents[NMO][NAEA]);
+      lwork = std::max( ma::getri_optimal_workspace_size(NN),
+              std::max( ma::gelqf_optimal_workspace_size(MN),
+                        ma::glq_optimal_workspace_size(MN) ) );
+      lwork = std::max(lwork,NMO);
+
+      // density matrix, overlap and exp(vHS) with NAEA fixed at compile time, if available
+      use_fixed_size_kernels(true);
 
     } 
 
+    /**
+     * Enables or disables the kernels specialized for NAEA (see fixed_size_kernels.hpp).
+     * They are enabled by setup when NAEA and NMO are in the specialized range.
+     * Returns true if they are in use.
+     */
+    bool use_fixed_size_kernels(bool enable)
+    {
+      auto k = base::get_fixed_size_kernels<ComplexType>(NMO,NAEA);
+      fixed_kernels = (enable && k)?(*k):base::fixed_size_kernels<ComplexType>();
+      return enable && k;
+    }
+
+    /**
+     * Keeps, for each of the density matrix, overlap and exp(vHS) kernels, the faster of the
+     * specialized and the generic version, timed on nw copies of the trial wave function.
+     * Requires the trial wave function. Returns the number of specialized kernels kept.
+     */
+    int select_fixed_size_kernels(int nw=8, int nrep=5)
+    {
+      auto k = base::get_fixed_size_kernels<ComplexType>(NMO,NAEA);
+      fixed_kernels = base::fixed_size_kernels<ComplexType>();
+      if(!k) return 0;
+      WalkerContainer W(extents[nw][2][NMO][NAEA]);
+      for(int n=0; n<nw; n++) {
+        W[n][0] = trialwfn_alpha;
+        W[n][1] = trialwfn_beta;
+      }
+      ComplexMatrix W_data(extents[nw][8]), G(extents[2*NAEA*NMO][nw]);
+      ComplexMatrix V(extents[NMO][NMO]), S(extents[NMO][NAEA]);
+      ComplexMatrix T1(extents[NMO][NAEA]), T2(extents[NMO][NAEA]);
+      for(int i=0; i<NMO; i++) V[i][i] = ComplexType(0.01);
+      int n = 0;
+      n += select_kernel(fixed_kernels.density_matrix,k->density_matrix,nrep,
+                         [&]() { calculate_mixed_density_matrix(W,W_data,G,true); });
+      n += select_kernel(fixed_kernels.overlap,k->overlap,nrep,
+                         [&]() { calculate_overlaps(W,W_data); });
+      n += select_kernel(fixed_kernels.expM,k->expM,nrep,
+                         [&]() { 
+                           for(int i=0; i<2*nw; i++) {
+                             S = trialwfn_alpha;
+                             apply_expM(V,S,T1,T2);
+                           }
+                         });
+      return n;
+    }
+
+    /**
+     * Comma separated list of the specialized kernels in use, or "none".
+     */
+    std::string fixed_size_kernels_name() const
+    {
+      std::string res;
+      if(fixed_kernels.density_matrix) res += ",dm";
+      if(fixed_kernels.overlap) res += ",overlap";
+      if(fixed_kernels.expM) res += ",expM";
+      return res.empty()?std::string("none"):res.substr(1);
+    }
+
     template< class WSet, 
-              class Mat 
+              class MatA,
+              class MatB
             >
-    void calculate_mixed_density_matrix(const WSet& W, Mat& W_data, Mat& G, bool compact=true)
+    void calculate_mixed_density_matrix(const WSet& W, MatA& W_data, MatB& G, bool compact=true)
     {
       int nwalk = W.shape()[0];
       assert(G.num_elements() >= 2*NAEA*NMO*nwalk);
       assert(W_data.shape()[0] >= nwalk);
       assert(W_data.shape()[1] >= 4);
       int N_ = compact?NAEA:NMO;
-      boost::multi_array_ref<ComplexType,2> DM(TMat_MM.data(), extents[N_][NMO]); 
+      ScratchScope scratch;
+      auto DM = scratch.matrix<ComplexType>(N_,NMO);
+      auto T1 = scratch.matrix<ComplexType>(NAEA,NAEA);
+      auto T2 = scratch.matrix<ComplexType>(NAEA,NMO);
+      auto IWORK = scratch.vector<int>(NAEA);
+      auto WORK = scratch.buffer<ComplexType>(lwork);
       boost::multi_array_ref<ComplexType,4> G_4D(G.data(), extents[2][N_][NMO][nwalk]); 
+      if(fixed_kernels.density_matrix) {
+        assert(W.strides()[2] == NAEA && W.strides()[3] == 1);
+        auto dm = fixed_kernels.density_matrix;
+        for(int n=0; n<nwalk; n++) {
+          W_data[n][2] = dm(NMO,trialwfn_alpha.origin(),W[n][0].origin(),DM.origin(),
+                            T1.origin(),T2.origin(),IWORK.origin(),compact);
+          G_4D[ indices[0][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
+          W_data[n][3] = dm(NMO,trialwfn_beta.origin(),W[n][1].origin(),DM.origin(),
+                            T1.origin(),T2.origin(),IWORK.origin(),compact);
+          G_4D[ indices[1][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
+        }
+        return;
+      }
       for(int n=0; n<nwalk; n++) {
         W_data[n][2] = base::MixedDensityMatrix<ComplexType>(trialwfn_alpha,W[n][0],
-                       DM,TMat_NN,TMat_NM,IWORK,WORK,compact);
+                       DM,T1,T2,IWORK,WORK,compact);
         G_4D[ indices[0][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
 
         W_data[n][3] = base::MixedDensityMatrix<ComplexType>(trialwfn_beta,W[n][1],
-                       DM,TMat_NN,TMat_NM,IWORK,WORK,compact);
+                       DM,T1,T2,IWORK,WORK,compact);
         G_4D[ indices[1][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
       }
     }
@@ -121,8 +192,9 @@ struct afqmc_sys: public AFQMCInfo
     RealType calculate_energy(Mat& W_data, const Mat& G, const Mat& haj, const SpMat& V) 
     {
       assert(G.shape()[0] == 2*NAEA*NMO);
-      if(G.shape()[1] != Gcloc.shape()[1])
-        Gcloc.resize(extents[2*NMO*NAEA][G.shape()[1]]);  
+      // contraction of the density matrix with the 2-electron integrals
+      ScratchScope scratch;
+      auto Gcloc = scratch.matrix<ComplexType>(2*NMO*NAEA,G.shape()[1]);
       base::calculate_energy(W_data,G,Gcloc,haj,V);
       RealType eav = 0., wgt=0.;
       for(int n=0, nw=G.shape()[1]; n<nw; n++) {
@@ -137,96 +209,282 @@ struct afqmc_sys: public AFQMCInfo
     {
       assert(W_data.shape()[0] >= W.shape()[0]);
       assert(W_data.shape()[1] >= 4);
+      ScratchScope scratch;
+      auto T1 = scratch.matrix<ComplexType>(NAEA,NAEA);
+      auto IWORK = scratch.vector<int>(NAEA);
+      if(fixed_kernels.overlap) {
+        assert(W.strides()[2] == NAEA && W.strides()[3] == 1);
+        auto ovlp = fixed_kernels.overlap;
+        for(int n=0, nw=W.shape()[0]; n<nw; n++) {
+          W_data[n][2] = ovlp(NMO,trialwfn_alpha.origin(),W[n][0].origin(),T1.origin(),IWORK.origin());
+          W_data[n][3] = ovlp(NMO,trialwfn_beta.origin(),W[n][1].origin(),T1.origin(),IWORK.origin());
+        }
+        return;
+      }
       for(int n=0, nw=W.shape()[0]; n<nw; n++) {
-        W_data[n][2] = base::Overlap<ComplexType>(trialwfn_alpha,W[n][0],TMat_NN,IWORK);
-        W_data[n][3] = base::Overlap<ComplexType>(trialwfn_beta,W[n][1],TMat_NN,IWORK);
+        W_data[n][2] = base::Overlap<ComplexType>(trialwfn_alpha,W[n][0],T1,IWORK);
+        W_data[n][3] = base::Overlap<ComplexType>(trialwfn_beta,W[n][1],T1,IWORK);
       }
     }
 
+    /**
+     * W[nw] = Propg * exp(vHS[nw]) * Propg * W[nw]
+     * If cond is not null, cond[nw] is set to the largest column_norm_ratio of the
+     * two determinants of walker nw, e.g. to decide when to orthogonalize it.
+     * Walkers are distributed among threads, as the blocks in propagate_streamed.
+     */
     template<class WSet, 
              class MatA,
              class MatB
             >
-    void propagate(WSet& W, const MatA& Propg, const MatB& vHS)
+    void propagate(WSet& W, const MatA& Propg, const MatB& vHS, RealType* cond=nullptr)
     {
       assert(vHS.shape()[0] == NMO*NMO);  
       using Type = typename std::decay<MatB>::type::element;
       boost::const_multi_array_ref<Type,3> V(vHS.data(), extents[NMO][NMO][vHS.shape()[1]]);
-      // re-interpretting matrices to avoid new temporary space  
-      boost::multi_array_ref<Type,2> T1(TMat_NM.data(), extents[NMO][NAEA]);
-      boost::multi_array_ref<Type,2> T2(TMat_MM2.data(), extents[NMO][NAEA]);
-      for(int nw=0, nwalk=W.shape()[0]; nw<nwalk; nw++) {
+      int nwalk = W.shape()[0];
+      #pragma omp parallel
+      {
+        ScratchScope scratch;
+        auto VM = scratch.matrix<Type>(NMO,NMO);
+        auto S = scratch.matrix<Type>(NMO,NAEA);
+        auto T1 = scratch.matrix<Type>(NMO,NAEA);
+        auto T2 = scratch.matrix<Type>(NMO,NAEA);
+        auto col_norms = scratch.vector<RealType>(NAEA);
+        #pragma omp for
+        for(int nw=0; nw<nwalk; nw++) {
+
+          // need deep-copy, since stride()[1] == nw otherwise
+          VM = V[ indices[range_t(0,NMO)][range_t(0,NMO)][nw] ];
+          propagate_walker(W,nw,Propg,VM,S,T1,T2,col_norms,cond);
+        }
+      }
 
-        // need deep-copy, since stride()[1] == nw otherwise
-        TMat_MM = V[ indices[range_t(0,NMO)][range_t(0,NMO)][nw] ];
+    }    
 
-        ma::product(Propg,W[nw][0],TMat_MN);
-        base::apply_expM(TMat_MM,TMat_MN,T1,T2,6);
-        ma::product(Propg,TMat_MN,W[nw][0]);
+    /**
+     * Same as get_vHS(Spvn,X,vHS) followed by propagate(W,Propg,vHS,cond), without the
+     * [NMO*NMO][nwalk] vHS matrix: vHS is calculated for blocks of nb walkers in a
+     * per-thread [NMO*NMO][nb] buffer, which is consumed right away by the propagation
+     * of the block. Blocks are distributed among threads.
+     */
+    template<class WSet, 
+             class MatA,
+             class SpMat,
+             class MatB
+            >
+    void propagate_streamed(WSet& W, const MatA& Propg, const SpMat& Spvn, const MatB& X, int nb, RealType* cond=nullptr)
+    {
+      assert(Spvn.rows() == NMO*NMO);  
+      assert(Spvn.cols() == X.shape()[0]);  
+      assert(X.shape()[1] == W.shape()[0]);  
+      using Type = typename std::decay<MatB>::type::element;
+      int nwalk = W.shape()[0];
+      nb = std::max(1,std::min(nb,nwalk));
+      int nblocks = (nwalk+nb-1)/nb;
+      #pragma omp parallel
+      {
+        ScratchScope scratch;
+        auto Vb = scratch.matrix<Type>(NMO*NMO,nb);
+        boost::multi_array_ref<Type,3> V(Vb.origin(), extents[NMO][NMO][nb]);
+        auto VM = scratch.matrix<Type>(NMO,NMO);
+        auto S = scratch.matrix<Type>(NMO,NAEA);
+        auto T1 = scratch.matrix<Type>(NMO,NAEA);
+        auto T2 = scratch.matrix<Type>(NMO,NAEA);
+        auto col_norms = scratch.vector<RealType>(NAEA);
+        #pragma omp for schedule(dynamic)
+        for(int b=0; b<nblocks; b++) {
+          int w0 = b*nb, w1 = std::min(nwalk,w0+nb);
+          Spvn.product('N',Type(1.),X[ indices[range_t()][range_t(w0,w1)] ],Type(0.),
+                       Vb[ indices[range_t()][range_t(0,w1-w0)] ]);
+          for(int nw=w0; nw<w1; nw++) {
+            VM = V[ indices[range_t(0,NMO)][range_t(0,NMO)][nw-w0] ];
+            propagate_walker(W,nw,Propg,VM,S,T1,T2,col_norms,cond);
+          }
+        }
+      }
+    }
 
-        ma::product(Propg,W[nw][1],TMat_MN);
-        base::apply_expM(TMat_MM,TMat_MN,T1,T2,6);
-        ma::product(Propg,TMat_MN,W[nw][1]);
+    /**
+     * Default block size of propagate_streamed: the largest one whose vHS buffer fits in L2
+     * (at least 1), but small enough to give every thread a block.
+     */
+    int streamed_block_size(int nwalk) const
+    {
+      int nb = std::max(1,int(l2_cache_size()/(std::size_t(NMO)*NMO*sizeof(ComplexType))));
+      int nt = omp_get_max_threads();
+      return std::max(1,std::min(nb,(nwalk+nt-1)/nt));
+    }
 
+    /**
+     * Same as above, with vHS in planar storage (see Matrix/PlanarMatrix.hpp).
+     * exp(vHS[nw]) is applied to the walkers with BLAS, so each vHS[nw] is gathered
+     * into an interleaved complex matrix first.
+     */
+    template<class WSet, 
+             class MatA,
+             class R
+            >
+    void propagate(WSet& W, const MatA& Propg, const PlanarMatrix<R>& vHS, RealType* cond=nullptr)
+    {
+      assert(vHS.rows() == NMO*NMO);  
+      using Type = std::complex<R>;
+      const R* vr = vHS.real();
+      const R* vi = vHS.imag();
+      int ldv = vHS.cols();
+      int nwalk = W.shape()[0];
+      #pragma omp parallel
+      {
+        ScratchScope scratch;
+        auto VM = scratch.matrix<Type>(NMO,NMO);
+        auto S = scratch.matrix<Type>(NMO,NAEA);
+        auto T1 = scratch.matrix<Type>(NMO,NAEA);
+        auto T2 = scratch.matrix<Type>(NMO,NAEA);
+        auto col_norms = scratch.vector<RealType>(NAEA);
+        Type* vm = VM.origin();
+        #pragma omp for
+        for(int nw=0; nw<nwalk; nw++) {
+          for(int ik=0; ik<NMO*NMO; ik++)
+            vm[ik] = Type(vr[ik*ldv+nw],vi[ik*ldv+nw]);
+          propagate_walker(W,nw,Propg,VM,S,T1,T2,col_norms,cond);
+        }
       }
-
     }    
 
+    /**
+     * Orthogonalizes the determinants of all walkers, see orthogonalize.hpp.
+     * The 2*nwalk determinants are distributed among threads, each with its own workspace.
+     * With ortho_cholqr2, determinants where the Cholesky factorization fails are
+     * orthogonalized with LQ.
+     * On return, logdet[2*nw+s] = log(det(R)) of the discarded triangular factor of
+     * determinant s of walker nw, logdet is [nwalk][2].
+     */
     template<class WSet>
-    void orthogonalize(WSet& W)
-    {
-      for(int i=0; i<W.shape()[0]; i++) {
-
-/*
-        // QR on the transpose
-        for(int r=0; r<NMO; r++)
-          for(int c=0; c<NAEA; c++)
-            TMat_NM[c][r] = W[i][0][r][c];   
-        ma::geqrf(TMat_NM,TAU,WORK);
-        ma::gqr(TMat_NM,TAU,WORK);
-        for(int r=0; r<NMO; r++)
-          for(int c=0; c<NAEA; c++)
-            W[i][0][r][c] = TMat_NM[c][r];   
-        for(int r=0; r<NMO; r++)
-          for(int c=0; c<NAEA; c++)
-            TMat_NM[c][r] = W[i][1][r][c];
-        ma::geqrf(TMat_NM,TAU,WORK);
-        ma::gqr(TMat_NM,TAU,WORK);
-        for(int r=0; r<NMO; r++)
-          for(int c=0; c<NAEA; c++)
-            W[i][1][r][c] = TMat_NM[c][r];
-*/
-
-        // LQ on the direct matrix
-        ma::gelqf(W[i][0],TAU,WORK);
-        ma::glq(W[i][0],TAU,WORK);
-        ma::gelqf(W[i][1],TAU,WORK);
-        ma::glq(W[i][1],TAU,WORK);
+    void orthogonalize(WSet& W, ComplexType* logdet, ortho_method method=ortho_lq)
+    {
+      orthogonalize_walkers(W,nullptr,W.shape()[0],logdet,method);
+    }
 
-      }
+    /**
+     * Orthogonalizes the walkers in the list, and updates the overlaps in W_data (columns 2 and 3)
+     * in place, <T|Q> = <T|W>/det(R), which avoids a call to calculate_overlaps.
+     * The update is done in log space.
+     */
+    template<class WSet, class Mat>
+    void orthogonalize(WSet& W, Mat& W_data, const std::vector<int>& walkers, ortho_method method=ortho_lq)
+    {
+      assert(W_data.shape()[0] >= W.shape()[0]);
+      assert(W_data.shape()[1] >= 4);
+      update_ortho_overlaps(W,W_data,walkers.data(),walkers.size(),method);
+    }
+
+    /**
+     * Same as above, for all walkers.
+     */
+    template<class WSet, class Mat>
+    void orthogonalize(WSet& W, Mat& W_data, ortho_method method=ortho_lq)
+    {
+      assert(W_data.shape()[0] >= W.shape()[0]);
+      assert(W_data.shape()[1] >= 4);
+      update_ortho_overlaps(W,W_data,nullptr,W.shape()[0],method);
     }
 
   private:
 
-    //! Buffers using std::vector
-    //! Used in QR and invert
-    std::vector<ComplexType> WORK; 
-    std::vector<int> IWORK; 
-
-    //! Vector used in QR routines 
-    ComplexVector TAU;
-
-    //! TMat_AB: Temporary Matrix of dimension [AxB]
-    //! N: NAEA
-    //! M: NMO
-    ComplexMatrix TMat_NN;
-    ComplexMatrix TMat_NM;
-    ComplexMatrix TMat_MN;
-    ComplexMatrix TMat_MM;
-    ComplexMatrix TMat_MM2;
-
-    //! storage for contraction of 2-electron integrals with density matrix
-    ComplexMatrix Gcloc;
+    // W[nw] = Propg * exp(VM) * Propg * W[nw], S, T1 and T2 are [NMO][NAEA] work arrays
+    template<class WSet, class MatA, class MatB, class MatC, class Vec>
+    void propagate_walker(WSet& W, int nw, const MatA& Propg, const MatB& VM, MatC& S, MatC& T1, MatC& T2, 
+                          Vec& col_norms, RealType* cond)
+    {
+      for(int s=0; s<2; s++) {
+        ma::product(Propg,W[nw][s],S);
+        apply_expM(VM,S,T1,T2);
+        ma::product(Propg,S,W[nw][s]);
+      }
+
+      if(cond)
+        cond[nw] = std::max(column_norm_ratio(W[nw][0],col_norms),
+                            column_norm_ratio(W[nw][1],col_norms));
+    }
+
+    // S = exp(VM)*S, with the specialized kernel if selected
+    template<class MatA, class MatB>
+    void apply_expM(const MatA& VM, MatB& S, MatB& T1, MatB& T2)
+    {
+      if(fixed_kernels.expM)
+        fixed_kernels.expM(NMO,VM.origin(),S.origin(),T1.origin(),T2.origin(),6);
+      else
+        base::apply_expM(VM,S,T1,T2,6);
+    }
+
+    // sets k to the faster of nullptr (generic kernel) and fixed when running f, returns true if fixed
+    template<class F, class Fn>
+    bool select_kernel(F& k, F fixed, int nrep, const Fn& f)
+    {
+      double t[2];
+      for(int i=0; i<2; i++) {
+        k = (i==0)?nullptr:fixed;
+        f();
+        double t0 = cpu_clock();
+        for(int r=0; r<nrep; r++) f();
+        t[i] = cpu_clock()-t0;
+      }
+      k = (t[1] < t[0])?fixed:nullptr;
+      return k != nullptr;
+    }
+
+    // orthogonalize for the walkers walkers[0..nw) (0..nw if walkers is null),
+    // logdet[2*i+s] is log(det(R)) of determinant s of the i-th walker in the list
+    template<class WSet>
+    void orthogonalize_walkers(WSet& W, const int* walkers, int nw, ComplexType* logdet_, ortho_method method)
+    {
+      int ndet = 2*nw;
+      #pragma omp parallel
+      {
+        ScratchScope scratch;
+        auto WORK_ = scratch.buffer<ComplexType>(lwork);
+        auto TAU_ = scratch.vector<ComplexType>(NMO);
+        auto S_ = scratch.matrix<ComplexType>(NAEA,NAEA);
+        #pragma omp for
+        for(int i=0; i<ndet; i++) {
+          int n = walkers?walkers[i/2]:i/2, s = i%2;
+          ComplexType& logdet = logdet_[i];
+          logdet = ComplexType(0);
+          switch(method) {
+            case ortho_cholqr2:
+              if(OrthogonalizeCholQR2(W[n][s],S_,logdet)) break;
+              // fall through
+            case ortho_lq:
+              logdet += OrthogonalizeLQ(W[n][s],TAU_,WORK_);
+              break;
+            case ortho_mgs:
+              logdet = OrthogonalizeMGS(W[n][s],TAU_);
+              break;
+          }
+        }
+      }
+    }
+
+    // orthogonalize_walkers and the update of the overlaps in W_data, the log-dets are
+    // kept in the scratch space of the calling thread
+    template<class WSet, class Mat>
+    void update_ortho_overlaps(WSet& W, Mat& W_data, const int* walkers, int nw, ortho_method method)
+    {
+      ScratchScope scratch;
+      ComplexType* logdet = scratch.allocate<ComplexType>(2*nw);
+      orthogonalize_walkers(W,walkers,nw,logdet,method);
+      for(int i=0; i<nw; i++) {
+        int n = walkers?walkers[i]:i;
+        W_data[n][2] = std::exp( std::log(W_data[n][2]) - logdet[2*i] );
+        W_data[n][3] = std::exp( std::log(W_data[n][3]) - logdet[2*i+1] );
+      }
+    }
+
+    //! size of lapack's work arrays
+    int lwork;
+
+    //! kernels specialized for NAEA, null members use the generic ones
+    base::fixed_size_kernels<ComplexType> fixed_kernels;
 };
 
 }
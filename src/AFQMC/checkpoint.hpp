@@ -0,0 +1,270 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file checkpoint.hpp
+ *  @brief Checkpoint/restart of the walker state
+ */
+
+#ifndef  AFQMC_CHECKPOINT_HPP
+#define  AFQMC_CHECKPOINT_HPP
+
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<thread>
+#include<iostream>
+#include<stdint.h>
+
+#include "Configuration.h"
+#include "io/hdf_archive.h"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+/**
+ * Walker state needed to resume a run:
+ *  - W: walkers, nwalk*2*NMO*NAEA
+ *  - W_data: walker data, nwalk*8
+ *  - step/step_tot: number of completed steps/substeps
+ *  - seed: seed of the (counter-based) random number generator.
+ *    Since the random numbers of a walker only depend on the seed, its global index
+ *    and step_tot, this is the full state of the generator.
+ *  - nsubsteps/northo/dt/ortho/vbias_cap/ortho_threshold: options that determine the
+ *    trajectory (ortho is a base::ortho_method). A restart with different values is
+ *    rejected, see same_options.
+ *  - since_ortho/ortho_cond: state of the adaptive orthogonalization, substeps since the
+ *    last orthogonalization and conditioning estimate of each walker, nwalk
+ */
+struct WalkerCheckpoint
+{
+  int nwalk=0, NMO=0, NAEA=0;
+  int walker_offset=0;
+  int step=0, step_tot=0;
+  uint32_t seed=0;
+  RealType Eshift=0;
+  int nsubsteps=0, northo=0, ortho=0;
+  RealType dt=0, vbias_cap=0, ortho_threshold=0;
+  std::vector<ComplexType> W;
+  std::vector<ComplexType> W_data;
+  std::vector<int> since_ortho;
+  std::vector<RealType> ortho_cond;
+
+  template<class WSet, class WData>
+  void set(const WSet& W_, const WData& W_data_, const std::vector<int>& since_ortho_,
+           const std::vector<RealType>& ortho_cond_)
+  {
+    nwalk = W_.shape()[0];
+    NMO = W_.shape()[2];
+    NAEA = W_.shape()[3];
+    W.assign(W_.data(),W_.data()+W_.num_elements());
+    W_data.assign(W_data_.data(),W_data_.data()+W_data_.num_elements());
+    since_ortho = since_ortho_;
+    ortho_cond = ortho_cond_;
+  }
+
+  // copies the walker state into W_, W_data_, since_ortho_ and ortho_cond_,
+  // which must have the dimensions of the checkpoint
+  template<class WSet, class WData>
+  bool get(WSet& W_, WData& W_data_, std::vector<int>& since_ortho_, std::vector<RealType>& ortho_cond_) const
+  {
+    if(W_.shape()[0] != std::size_t(nwalk) || W_.shape()[2] != std::size_t(NMO) ||
+       W_.shape()[3] != std::size_t(NAEA) ||
+       W_.num_elements() != W.size() || W_data_.num_elements() != W_data.size() ||
+       since_ortho_.size() != since_ortho.size() || ortho_cond_.size() != ortho_cond.size()) {
+      std::cerr<<" Error: Walker dimensions do not match checkpoint: (nwalk,NMO,NAEA) = ("
+               <<nwalk <<"," <<NMO <<"," <<NAEA <<")" <<std::endl;
+      return false;
+    }
+    std::copy(W.begin(),W.end(),W_.data());
+    std::copy(W_data.begin(),W_data.end(),W_data_.data());
+    since_ortho_ = since_ortho;
+    ortho_cond_ = ortho_cond;
+    return true;
+  }
+
+  // true if the checkpoint was written with the given options
+  bool same_options(int nsubsteps_, int northo_, RealType dt_, int ortho_, RealType vbias_cap_,
+                    RealType ortho_threshold_) const
+  {
+    if(nsubsteps_ != nsubsteps || northo_ != northo || dt_ != dt || ortho_ != ortho ||
+       vbias_cap_ != vbias_cap || ortho_threshold_ != ortho_threshold) {
+      std::cerr<<" Error: Options do not match checkpoint: (nsubsteps,northo,dt,ortho,vbias_cap,ortho_threshold) = ("
+               <<nsubsteps <<"," <<northo <<"," <<dt <<"," <<ortho <<"," <<vbias_cap <<","
+               <<ortho_threshold <<")" <<std::endl;
+      return false;
+    }
+    return true;
+  }
+};
+
+/**
+ * Writes the checkpoint to file fname.
+ * The file is written under a temporary name and renamed when complete,
+ * so an interrupted write never destroys the previous checkpoint.
+ */
+inline bool write_checkpoint(const std::string& fname, const WalkerCheckpoint& c)
+{
+  std::string tmp = fname + ".tmp";
+  hdf_archive dump;
+  if(!dump.create(tmp)) {
+    std::cerr<<" Error: Problems creating checkpoint file: " <<tmp <<std::endl;
+    return false;
+  }
+  dump.push("Checkpoint");
+  std::vector<int> Idata{c.nwalk, c.NMO, c.NAEA, c.walker_offset, c.step, c.step_tot, static_cast<int>(c.seed)};
+  std::vector<RealType> Rdata{c.Eshift};
+  std::vector<int> Odata{c.nsubsteps, c.northo, c.ortho};
+  std::vector<RealType> ROdata{c.dt, c.vbias_cap, c.ortho_threshold};
+  std::vector<ComplexType>& W = const_cast<std::vector<ComplexType>&>(c.W);
+  std::vector<ComplexType>& W_data = const_cast<std::vector<ComplexType>&>(c.W_data);
+  std::vector<int>& since_ortho = const_cast<std::vector<int>&>(c.since_ortho);
+  std::vector<RealType>& ortho_cond = const_cast<std::vector<RealType>&>(c.ortho_cond);
+  bool ok = dump.write(Idata,"dims") && dump.write(Rdata,"Eshift") &&
+            dump.write(Odata,"options") && dump.write(ROdata,"real_options") &&
+            dump.write(W,"W") && dump.write(W_data,"W_data") &&
+            dump.write(since_ortho,"since_ortho") && dump.write(ortho_cond,"ortho_cond");
+  dump.pop();
+  dump.close();
+  if(!ok) {
+    std::cerr<<" Error: Problems writing checkpoint file: " <<tmp <<std::endl;
+    return false;
+  }
+  if(std::rename(tmp.c_str(),fname.c_str()) != 0) {
+    std::cerr<<" Error: Problems renaming checkpoint file: " <<tmp <<std::endl;
+    return false;
+  }
+  return true;
+}
+
+inline bool read_checkpoint(const std::string& fname, WalkerCheckpoint& c)
+{
+  hdf_archive dump;
+  if(!dump.open(fname,H5F_ACC_RDONLY)) {
+    std::cerr<<" Error: Problems opening checkpoint file: " <<fname <<std::endl;
+    return false;
+  }
+  if(!dump.is_group( std::string("/Checkpoint") )) {
+    std::cerr<<" Error: H5Group /Checkpoint does not exist. \n";
+    return false;
+  }
+  if(!dump.push("Checkpoint",false)) return false;
+  std::vector<int> Idata(7);
+  std::vector<RealType> Rdata(1);
+  std::vector<int> Odata(3);
+  std::vector<RealType> ROdata(3);
+  if(!dump.read(Idata,"dims")) return false;
+  if(!dump.read(Rdata,"Eshift")) return false;
+  if(!dump.read(Odata,"options")) return false;
+  if(!dump.read(ROdata,"real_options")) return false;
+  if(!dump.read(c.W,"W")) return false;
+  if(!dump.read(c.W_data,"W_data")) return false;
+  if(!dump.read(c.since_ortho,"since_ortho")) return false;
+  if(!dump.read(c.ortho_cond,"ortho_cond")) return false;
+  dump.pop();
+  dump.close();
+  c.nwalk = Idata[0];
+  c.NMO = Idata[1];
+  c.NAEA = Idata[2];
+  c.walker_offset = Idata[3];
+  c.step = Idata[4];
+  c.step_tot = Idata[5];
+  c.seed = static_cast<uint32_t>(Idata[6]);
+  c.Eshift = Rdata[0];
+  c.nsubsteps = Odata[0];
+  c.northo = Odata[1];
+  c.ortho = Odata[2];
+  c.dt = ROdata[0];
+  c.vbias_cap = ROdata[1];
+  c.ortho_threshold = ROdata[2];
+  if(c.W.size() != std::size_t(c.nwalk)*2*c.NMO*c.NAEA || c.W_data.size() != std::size_t(c.nwalk)*8 ||
+     c.since_ortho.size() != std::size_t(c.nwalk) || c.ortho_cond.size() != std::size_t(c.nwalk)) {
+    std::cerr<<" Error: Inconsistent dimensions in checkpoint file: " <<fname <<std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Writes checkpoints from a background thread.
+ * write() takes a copy of the walker state and returns immediately, the hdf5 file
+ * is written while the calculation continues. A new write (or wait()) first waits
+ * for the previous one to finish.
+ * HDF5 is not assumed to be thread safe: no other hdf5 file can be accessed
+ * while a write is in progress.
+ */
+class CheckpointWriter
+{
+  public:
+
+  // the options of the run (see WalkerCheckpoint) are written with every checkpoint
+  CheckpointWriter(const std::string& fname, int nsubsteps, int northo, RealType dt, int ortho,
+                   RealType vbias_cap, RealType ortho_threshold):
+    filename(fname),status(true)
+  {
+    data.nsubsteps = nsubsteps;
+    data.northo = northo;
+    data.dt = dt;
+    data.vbias_cap = vbias_cap;
+    data.ortho_threshold = ortho_threshold;
+    data.ortho = ortho;
+  }
+
+  ~CheckpointWriter() { wait(); }
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  template<class WSet, class WData>
+  void write(int step, int step_tot, uint32_t seed, int walker_offset, RealType Eshift,
+             const WSet& W, const WData& W_data, const std::vector<int>& since_ortho,
+             const std::vector<RealType>& ortho_cond)
+  {
+    if(!wait())
+      std::cerr<<" Warning: Previous checkpoint was not written. \n";
+    data.step = step;
+    data.step_tot = step_tot;
+    data.seed = seed;
+    data.walker_offset = walker_offset;
+    data.Eshift = Eshift;
+    data.set(W,W_data,since_ortho,ortho_cond);
+    worker = std::thread([this] { status = write_checkpoint(filename,data); });
+  }
+
+  // waits for the write in progress, returns false if it failed
+  bool wait()
+  {
+    if(worker.joinable()) worker.join();
+    return status;
+  }
+
+  const std::string& name() const { return filename; }
+
+  private:
+
+  std::string filename;
+  bool status;
+  WalkerCheckpoint data;
+  std::thread worker;
+
+};
+
+}
+
+}
+
+#endif
@@ -54,6 +54,8 @@ namespace base
  *   followed by a dot product between vectors, if we interpret the matrix \f$ G_\text{mod}(a,k)\f$
  *   as a vector with "linearized" index $\mathrm{ak}=a\times \mathrm{NMO} + k$.
  *
+ *   Vakbl can be stored in any format supported by ma::product (see MatrixOperator).
+ *
  * TODO: handle l-value references properly
  *
  * TODO: add dimensionality information in concept
@@ -61,9 +63,10 @@ namespace base
  * TODO: avoid use of multi_array_ref
  */
 template< class Mat,
+          class MatC,
           class SpMat
         >
-inline void calculate_energy(Mat& W_data, const Mat& Gc, Mat& Gcloc, const Mat& haj, const SpMat& Vakbl)
+inline void calculate_energy(Mat& W_data, const Mat& Gc, MatC&& Gcloc, const Mat& haj, const SpMat& Vakbl)
 {
   // W[nwalk][2][NMO][NAEA]
  
@@ -86,7 +89,7 @@ inline void calculate_energy(Mat& W_data, const Mat& Gc, Mat& Gcloc, const Mat&
 
   for(int n=0; n<nwalk; n++) W_data[n][0] = zero; //< zero
 
-  ma::product(Vakbl, Gc, Gcloc);   //< Vakbl * Gc(bl,nw) = Gcloc(ak,nw)
+  ma::product(Vakbl, Gc, std::forward<MatC>(Gcloc));   //< Vakbl * Gc(bl,nw) = Gcloc(ak,nw)
 
   //! \f$ E_2(nw) = 0.5 G_c(:,nw)*Gcloc(:,nw)\f$
   // how do I do this through BLAS?
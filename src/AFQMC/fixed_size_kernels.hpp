@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file fixed_size_kernels.hpp
+ *  @brief Walker kernels with the number of electrons fixed at compile time
+ *
+ *  Versions of MixedDensityMatrix, Overlap and apply_expM for small active spaces,
+ *  where the fixed overhead of the BLAS/LAPACK calls dominates. The number of electrons
+ *  NEL is a template parameter, so the loops over electrons (the innermost ones) have
+ *  constant trip counts and are unrolled and vectorized by the compiler. The number of
+ *  orbitals only bounds the outer loops and stays a runtime argument.
+ *
+ *  Products are accumulated in separate real and imaginary arrays, which vectorize
+ *  without shuffles. The [NEL][NEL] matrix T(B)*conj(A) is factorized with an LU
+ *  decomposition with partial pivoting, and the density matrix is obtained by solving
+ *  with the factors instead of forming the inverse.
+ *
+ *  All matrices are row-major and contiguous: walkers and trial wave functions [nmo][NEL],
+ *  V [nmo][nmo]. get_fixed_size_kernels returns the kernels for a given NEL, or nullptr
+ *  if the dimensions are outside the specialized range and the generic versions must be used.
+ */
+
+#ifndef  AFQMC_FIXED_SIZE_KERNELS_HPP
+#define  AFQMC_FIXED_SIZE_KERNELS_HPP
+
+#include<complex>
+#include<cmath>
+#include<algorithm>
+
+namespace qmcplusplus
+{
+
+namespace base
+{
+
+// largest NEL and nmo of the specialized kernels
+const int fixed_max_nel = 32;
+const int fixed_max_nmo = 128;
+
+template<class T>
+struct fixed_size_kernels
+{
+  // C = <A|c+i cj|B>/<A|B>, [NEL][nmo] if compact, [nmo][nmo] otherwise. Returns <A|B>.
+  // T1: [NEL][NEL], T2: [NEL][nmo] (only used if not compact), piv: [NEL]
+  T (*density_matrix)(int nmo, const T* conjA, const T* B, T* C, T* T1, T* T2, int* piv, bool compact);
+  // returns <A|B> = det[ T(B) * conj(A) ], T1: [NEL][NEL], piv: [NEL]
+  T (*overlap)(int nmo, const T* conjA, const T* B, T* T1, int* piv);
+  // S = exp(V)*S with a Taylor expansion, S, T1 and T2: [nmo][NEL]
+  void (*expM)(int nmo, const T* V, T* S, T* T1, T* T2, int order);
+
+  fixed_size_kernels():density_matrix(nullptr),overlap(nullptr),expM(nullptr) {}
+  fixed_size_kernels(decltype(density_matrix) dm, decltype(overlap) ov, decltype(expM) ex):
+    density_matrix(dm),overlap(ov),expM(ex) {}
+};
+
+namespace fixed
+{
+
+template<class T>
+inline typename T::value_type cabs1(const T& a) { return std::abs(a.real())+std::abs(a.imag()); }
+
+// (xr,xi) -= l*(yr,yi), vectors of length n
+template<class R, class T>
+inline void split_axmy(int n, const T l, R* xr, R* xi, const R* yr, const R* yi)
+{
+  const R lr = l.real(), li = l.imag();
+  #pragma omp simd
+  for(int j=0; j<n; j++) {
+    xr[j] -= lr*yr[j] - li*yi[j];
+    xi[j] -= lr*yi[j] + li*yr[j];
+  }
+}
+
+// T1 = T(B) * conjA, the products are accumulated in split real/imaginary arrays
+template<int NEL, class T>
+inline void product_TB_A(int nmo, const T* conjA, const T* B, T* T1)
+{
+  using R = typename T::value_type;
+  R tr[NEL*NEL], ti[NEL*NEL];
+  std::fill_n(tr,NEL*NEL,R(0));
+  std::fill_n(ti,NEL*NEL,R(0));
+  for(int i=0; i<nmo; i++) {
+    R ar[NEL], ai[NEL];
+    for(int q=0; q<NEL; q++) {
+      ar[q] = conjA[i*NEL+q].real();
+      ai[q] = conjA[i*NEL+q].imag();
+    }
+    const T* b = B+i*NEL;
+    for(int p=0; p<NEL; p++) {
+      const R br = b[p].real(), bi = b[p].imag();
+      R* r = tr+p*NEL;
+      R* c = ti+p*NEL;
+      #pragma omp simd
+      for(int q=0; q<NEL; q++) {
+        r[q] += br*ar[q] - bi*ai[q];
+        c[q] += br*ai[q] + bi*ar[q];
+      }
+    }
+  }
+  for(int k=0; k<NEL*NEL; k++)
+    T1[k] = T(tr[k],ti[k]);
+}
+
+// in-place LU factorization with partial pivoting, returns the determinant
+template<int NEL, class T>
+inline T lu(T* A, int* piv)
+{
+  T det(1.0);
+  for(int k=0; k<NEL; k++) {
+    int p = k;
+    for(int i=k+1; i<NEL; i++)
+      if(cabs1(A[i*NEL+k]) > cabs1(A[p*NEL+k])) p = i;
+    piv[k] = p;
+    if(p != k) {
+      std::swap_ranges(A+k*NEL,A+(k+1)*NEL,A+p*NEL);
+      det = -det;
+    }
+    const T akk = A[k*NEL+k];
+    det *= akk;
+    if(akk == T(0)) continue;
+    const T inv = T(1.0)/akk;
+    for(int i=k+1; i<NEL; i++) {
+      T l = (A[i*NEL+k] *= inv);
+      for(int j=k+1; j<NEL; j++)
+        A[i*NEL+j] -= l*A[k*NEL+j];
+    }
+  }
+  return det;
+}
+
+// (Xr,Xi) = A^(-1) * (Xr,Xi), with A factorized by lu, X: [NEL][m] in split storage
+template<int NEL, class T, class R>
+inline void lu_solve(const T* LU, const int* piv, int m, R* Xr, R* Xi)
+{
+  for(int k=0; k<NEL; k++)
+    if(piv[k] != k) {
+      std::swap_ranges(Xr+k*m,Xr+(k+1)*m,Xr+piv[k]*m);
+      std::swap_ranges(Xi+k*m,Xi+(k+1)*m,Xi+piv[k]*m);
+    }
+  for(int k=0; k<NEL; k++)
+    for(int i=k+1; i<NEL; i++)
+      split_axmy(m,LU[i*NEL+k],Xr+i*m,Xi+i*m,Xr+k*m,Xi+k*m);
+  for(int k=NEL-1; k>=0; k--) {
+    const T inv = T(1.0)/LU[k*NEL+k];
+    const R vr = inv.real(), vi = inv.imag();
+    R* xr = Xr+k*m;
+    R* xi = Xi+k*m;
+    #pragma omp simd
+    for(int j=0; j<m; j++) {
+      R r = xr[j];
+      xr[j] = vr*r - vi*xi[j];
+      xi[j] = vr*xi[j] + vi*r;
+    }
+    for(int i=0; i<k; i++)
+      split_axmy(m,LU[i*NEL+k],Xr+i*m,Xi+i*m,xr,xi);
+  }
+}
+
+template<int NEL, class T>
+inline T density_matrix(int nmo, const T* conjA, const T* B, T* C, T* T1, T* T2, int* piv, bool compact)
+{
+  using R = typename T::value_type;
+  product_TB_A<NEL>(nmo,conjA,B,T1);
+  T ovlp = lu<NEL>(T1,piv);
+  // X = T1^(-1) * T(B), in split storage in T2
+  R* Xr = reinterpret_cast<R*>(T2);
+  R* Xi = Xr+NEL*nmo;
+  for(int i=0; i<nmo; i++)
+    for(int p=0; p<NEL; p++) {
+      Xr[p*nmo+i] = B[i*NEL+p].real();
+      Xi[p*nmo+i] = B[i*NEL+p].imag();
+    }
+  lu_solve<NEL>(T1,piv,nmo,Xr,Xi);
+  if(compact) {
+    for(int k=0; k<NEL*nmo; k++)
+      C[k] = T(Xr[k],Xi[k]);
+  } else {
+    // C = conjA * X
+    R cr[fixed_max_nmo], ci[fixed_max_nmo];
+    for(int i=0; i<nmo; i++) {
+      std::fill_n(cr,nmo,R(0));
+      std::fill_n(ci,nmo,R(0));
+      for(int p=0; p<NEL; p++)
+        split_axmy(nmo,-conjA[i*NEL+p],cr,ci,Xr+p*nmo,Xi+p*nmo);
+      T* c = C+i*nmo;
+      for(int j=0; j<nmo; j++)
+        c[j] = T(cr[j],ci[j]);
+    }
+  }
+  return ovlp;
+}
+
+template<int NEL, class T>
+inline T overlap(int nmo, const T* conjA, const T* B, T* T1, int* piv)
+{
+  product_TB_A<NEL>(nmo,conjA,B,T1);
+  return lu<NEL>(T1,piv);
+}
+
+// the terms of the expansion are kept in split storage in T1 and T2
+template<int NEL, class T>
+inline void expM(int nmo, const T* V, T* S, T* T1, T* T2, int order)
+{
+  using R = typename T::value_type;
+  R* Pr = reinterpret_cast<R*>(T1);
+  R* Pi = Pr+nmo*NEL;
+  R* Qr = reinterpret_cast<R*>(T2);
+  R* Qi = Qr+nmo*NEL;
+  for(int k=0; k<nmo*NEL; k++) {
+    Pr[k] = S[k].real();
+    Pi[k] = S[k].imag();
+  }
+  for(int n=1; n<=order; n++) {
+    // Q = i/n * V * P, S += Q, one row at a time
+    const R fact = R(1.0)/static_cast<R>(n);
+    for(int i=0; i<nmo; i++) {
+      R accr[NEL], acci[NEL];
+      for(int q=0; q<NEL; q++) accr[q] = acci[q] = R(0);
+      const T* v = V+i*nmo;
+      for(int k=0; k<nmo; k++) {
+        const R vr = v[k].real(), vi = v[k].imag();
+        const R* pr = Pr+k*NEL;
+        const R* pi = Pi+k*NEL;
+        #pragma omp simd
+        for(int q=0; q<NEL; q++) {
+          accr[q] += vr*pr[q] - vi*pi[q];
+          acci[q] += vr*pi[q] + vi*pr[q];
+        }
+      }
+      R* qr = Qr+i*NEL;
+      R* qi = Qi+i*NEL;
+      T* s = S+i*NEL;
+      for(int q=0; q<NEL; q++) {
+        qr[q] = -fact*acci[q];
+        qi[q] = fact*accr[q];
+        s[q] += T(qr[q],qi[q]);
+      }
+    }
+    std::swap(Pr,Qr);
+    std::swap(Pi,Qi);
+  }
+}
+
+// linear search over NEL = N, N-1, ..., 1
+template<class T, int N>
+struct dispatch
+{
+  static const fixed_size_kernels<T>* get(int nel)
+  {
+    static const fixed_size_kernels<T> k(&density_matrix<N,T>,&overlap<N,T>,&expM<N,T>);
+    return (nel == N)?(&k):dispatch<T,N-1>::get(nel);
+  }
+};
+
+template<class T>
+struct dispatch<T,0>
+{
+  static const fixed_size_kernels<T>* get(int) { return nullptr; }
+};
+
+}
+
+/**
+ * Kernels specialized for nel electrons and nmo orbitals, nullptr if there are none.
+ */
+template<class T>
+inline const fixed_size_kernels<T>* get_fixed_size_kernels(int nmo, int nel)
+{
+  if(nmo > fixed_max_nmo || nel > fixed_max_nel || nel > nmo) return nullptr;
+  return fixed::dispatch<T,fixed_max_nel>::get(nel);
+}
+
+}
+
+}
+
+#endif
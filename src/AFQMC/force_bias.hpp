@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file force_bias.hpp
+ *  @brief Auxiliary fields and hybrid weight
+ */
+
+#ifndef  AFQMC_FORCE_BIAS_HPP
+#define  AFQMC_FORCE_BIAS_HPP
+
+#include<cmath>
+#include<vector>
+#include<complex>
+#include<algorithm>
+#include<stdint.h>
+#include "Utilities/ScratchArena.h"
+#include "Matrix/PlanarMatrix.hpp"
+
+namespace qmcplusplus
+{
+
+namespace base
+{
+
+/**
+ * Adds the contribution of one row of X (one Cholesky vector) to the hybrid weight, and
+ * writes the row of X. Works on real and imaginary parts explicitly, to avoid the overhead
+ * of std::complex multiplication and to allow vectorization.
+ *  - vb: row of vbias, z: normal random numbers, x: row of X (output)
+ *  - hr/hi: per-walker partial sums
+ */
+template<class T>
+inline void force_bias_row(int nwalk, const std::complex<T>* vb, const T* z, std::complex<T>* x, T* hr, T* hi, T cap)
+{
+  const T* v = reinterpret_cast<const T*>(vb);
+  T* X = reinterpret_cast<T*>(x);
+  const T cap2 = cap*cap;
+  #pragma omp simd
+  for(int w=0; w<nwalk; w++) {
+    T vr = v[2*w], vi = v[2*w+1];
+    if(cap > 0) {
+      T v2 = vr*vr+vi*vi;
+      T s = (v2 > cap2)?cap/std::sqrt(v2):T(1);
+      vr *= s;
+      vi *= s;
+    }
+    T xr = z[w];
+    hr[w] += vr*xr - vr*vi;
+    hi[w] += vi*xr + T(0.5)*(vr*vr-vi*vi);
+    X[2*w] = xr - vi;
+    X[2*w+1] = vr;
+  }
+}
+
+/**
+ * Same as above, with vbias and X in planar storage.
+ */
+template<class T>
+inline void force_bias_row(int nwalk, const T* vre, const T* vim, const T* z, T* xre, T* xim, T* hr, T* hi, T cap)
+{
+  const T cap2 = cap*cap;
+  #pragma omp simd
+  for(int w=0; w<nwalk; w++) {
+    T vr = vre[w], vi = vim[w];
+    if(cap > 0) {
+      T v2 = vr*vr+vi*vi;
+      T s = (v2 > cap2)?cap/std::sqrt(v2):T(1);
+      vr *= s;
+      vi *= s;
+    }
+    T xr = z[w];
+    hr[w] += vr*xr - vr*vi;
+    hi[w] += vi*xr + T(0.5)*(vr*vr-vi*vi);
+    xre[w] = xr - vi;
+    xim[w] = vr;
+  }
+}
+
+// number of walkers per tile in sample_auxiliary_fields
+const int force_bias_tile = 16;
+
+/**
+ * Draws the normal random numbers of walkers [w0,w0+nw) (see sample_auxiliary_fields)
+ * into zt, transposed: zt[n*force_bias_tile+w] is the number of Cholesky vector n of walker w0+w.
+ * z is a work array of nw*nchol elements.
+ */
+template<class RNG, class R>
+inline void generate_normal_tile(RNG& rng, int wid0, int step, int w0, int nw, int nchol, R* z, R* zt)
+{
+  for(int w=0; w<nw; w++) {
+    rng.set_stream(static_cast<uint64_t>(wid0+w0+w));
+    rng.set_counter(static_cast<uint64_t>(step)<<32);
+    rng.generate_normal(z+w*nchol,nchol);
+  }
+  for(int n=0; n<nchol; n++)
+    for(int w=0; w<nw; w++)
+      zt[n*force_bias_tile+w] = z[w*nchol+n];
+}
+
+/**
+ * Calculates the auxiliary fields and the hybrid weight:
+ *
+ *  \f$ X(n,w) = x(n,w) + i vbias(n,w) \f$
+ *
+ *  \f$ hybridW(w) = -i \sum_n vbias(n,w) ( x(n,w) + \frac{i}{2} vbias(n,w) ) \f$
+ *
+ * where x(n,w) are normal random numbers, generated in tiles of force_bias_tile walkers
+ * so that vbias and X are swept only once.
+ * If cap > 0, the force bias is capped: |vbias(n,w)| <= cap.
+ * The numbers of walker w are drawn from its own stream of rng (a counter-based generator):
+ * stream = wid0+w (global walker id), positioned at block step<<32.
+ * The result depends only on (seed, global walker id, step), not on the number
+ * of threads or on how walkers are distributed among batches or ranks.
+ */
+template< class RNG,
+          class MatA,
+          class MatB,
+          class Vec
+        >
+inline void sample_auxiliary_fields(const RNG& rng, int wid0, int step, const MatA& vbias, MatB&& X, Vec&& hybridW, double cap=0.0)
+{
+  assert( vbias.shape()[0] == X.shape()[0] );
+  assert( vbias.shape()[1] == X.shape()[1] );
+  assert( hybridW.shape()[0] == X.shape()[1] );
+  assert( vbias.strides()[1] == 1 );
+  assert( X.strides()[1] == 1 );
+
+  using Type = typename std::decay<MatB>::type::element;
+  using RType = typename Type::value_type;
+  const int tile = force_bias_tile;
+  int nchol = X.shape()[0];
+  int nwalk = X.shape()[1];
+  int ntiles = (nwalk+tile-1)/tile;
+  // the numbers of a tile of walkers are generated and transposed in scratch space,
+  // vbias and X are then swept once, in tiles of columns
+  #pragma omp parallel
+  {
+    RNG rng_(rng);
+    ScratchScope scratch;
+    RType* z = scratch.allocate<RType>(tile*nchol);
+    RType* zt = scratch.allocate<RType>(nchol*tile);
+    RType* hr = scratch.allocate<RType>(tile);
+    RType* hi = scratch.allocate<RType>(tile);
+    #pragma omp for
+    for(int t=0; t<ntiles; t++) {
+      int w0 = t*tile, nw = std::min(tile,nwalk-w0);
+      generate_normal_tile(rng_,wid0,step,w0,nw,nchol,z,zt);
+      std::fill_n(hr,tile,RType(0));
+      std::fill_n(hi,tile,RType(0));
+      for(int n=0; n<nchol; n++)
+        force_bias_row(nw,vbias[n].origin()+w0,zt+n*tile,X[n].origin()+w0,hr,hi,RType(cap));
+      for(int w=0; w<nw; w++)
+        hybridW[w0+w] = Type(hi[w],-hr[w]);
+    }
+  }
+}
+
+/**
+ * Same as above, with vbias and X in planar storage (see Matrix/PlanarMatrix.hpp).
+ */
+template< class RNG,
+          class R,
+          class Vec
+        >
+inline void sample_auxiliary_fields(const RNG& rng, int wid0, int step, const PlanarMatrix<R>& vbias, PlanarMatrix<R>& X, Vec&& hybridW, double cap=0.0)
+{
+  assert( vbias.rows() == X.rows() );
+  assert( vbias.cols() == X.cols() );
+  assert( hybridW.shape()[0] == X.cols() );
+
+  using Type = std::complex<R>;
+  const int tile = force_bias_tile;
+  int nchol = X.rows();
+  int nwalk = X.cols();
+  int ntiles = (nwalk+tile-1)/tile;
+  #pragma omp parallel
+  {
+    RNG rng_(rng);
+    ScratchScope scratch;
+    R* z = scratch.allocate<R>(tile*nchol);
+    R* zt = scratch.allocate<R>(nchol*tile);
+    R* hr = scratch.allocate<R>(tile);
+    R* hi = scratch.allocate<R>(tile);
+    #pragma omp for
+    for(int t=0; t<ntiles; t++) {
+      int w0 = t*tile, nw = std::min(tile,nwalk-w0);
+      generate_normal_tile(rng_,wid0,step,w0,nw,nchol,z,zt);
+      std::fill_n(hr,tile,R(0));
+      std::fill_n(hi,tile,R(0));
+      for(int n=0; n<nchol; n++)
+        force_bias_row(nw,vbias.real(n)+w0,vbias.imag(n)+w0,zt+n*tile,X.real(n)+w0,X.imag(n)+w0,hr,hi,R(cap));
+      for(int w=0; w<nw; w++)
+        hybridW[w0+w] = Type(hi[w],-hr[w]);
+    }
+  }
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file kernel_costs.hpp
+ *  @brief Analytic flop and byte counts of the AFQMC kernels
+ *
+ *  Counts are nominal: they assume complex double precision (8 real flops per
+ *  multiply-add, 16 bytes per element), count the useful work of sparse products
+ *  from the number of non-zeros (independently of the storage format) and the
+ *  compulsory traffic of every operand (each matrix read or written once per call).
+ *  They are meant to compare kernels against the roofline of the machine, e.g.
+ *  through NewTimer::add_work.
+ */
+
+#ifndef  AFQMC_KERNEL_COSTS_HPP
+#define  AFQMC_KERNEL_COSTS_HPP
+
+#include "AFQMC/orthogonalize.hpp"
+
+namespace qmcplusplus
+{
+
+namespace base
+{
+
+struct kernel_cost
+{
+  double flops;
+  double bytes;
+
+  kernel_cost(double f=0.0, double b=0.0):flops(f),bytes(b) {}
+
+  kernel_cost& operator+=(const kernel_cost& other)
+  {
+    flops += other.flops;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+inline kernel_cost operator+(kernel_cost a, const kernel_cost& b) { return a += b; }
+inline kernel_cost operator*(double x, const kernel_cost& a) { return kernel_cost(x*a.flops,x*a.bytes); }
+
+const double complex_size = 16.0;
+const double index_size = 4.0;
+
+/// C[m][n] = A[m][k] * B[k][n]
+inline kernel_cost gemm_cost(double m, double n, double k)
+{
+  return kernel_cost(8.0*m*n*k, complex_size*(m*k+k*n+m*n));
+}
+
+/// C[nr][nrhs] = A[nr][nc] * B[nc][nrhs], with A in CSR format with nnz non-zeros
+inline kernel_cost csrmm_cost(double nnz, double nr, double nc, double nrhs)
+{
+  return kernel_cost(8.0*nnz*nrhs,
+                     nnz*(complex_size+index_size) + (nr+1)*index_size + complex_size*(nc+nr)*nrhs);
+}
+
+/// LU factorization of a [n][n] matrix, with determinant
+inline kernel_cost getrf_cost(double n)
+{
+  return kernel_cost(8.0/3.0*n*n*n, 2.0*complex_size*n*n);
+}
+
+/// inverse of a [n][n] matrix through LU (getrf+getri)
+inline kernel_cost invert_cost(double n)
+{
+  return getrf_cost(n) + kernel_cost(16.0/3.0*n*n*n, 2.0*complex_size*n*n);
+}
+
+/// LQ factorization of [m][n] (m<=n) and generation of Q (gelqf+glq)
+inline kernel_cost lq_cost(double m, double n)
+{
+  return 2.0*kernel_cost(4.0*(2.0*m*m*n-2.0/3.0*m*m*m), 2.0*complex_size*m*n);
+}
+
+/// base::get_vbias, Spvn is the transposed [nchol][2*NMO*NAEA] matrix if transposed
+template<class SpMat>
+inline kernel_cost vbias_cost(const SpMat& Spvn, int nwalk, bool transposed)
+{
+  if(transposed)
+    return csrmm_cost(Spvn.size(),Spvn.rows(),Spvn.cols(),nwalk);
+  // T(Spvn)*G for alpha and beta, the second product accumulates into vbias
+  return 2.0*csrmm_cost(Spvn.size(),Spvn.cols(),Spvn.rows(),nwalk)
+         + kernel_cost(0.0,complex_size*Spvn.cols()*nwalk);
+}
+
+/// base::get_vHS
+template<class SpMat>
+inline kernel_cost vHS_cost(const SpMat& Spvn, int nwalk)
+{
+  return csrmm_cost(Spvn.size(),Spvn.rows(),Spvn.cols(),nwalk);
+}
+
+/// base::apply_expM on a [NMO][NAEA] matrix
+inline kernel_cost apply_expM_cost(int NMO, int NAEA, int order=6)
+{
+  double MN = double(NMO)*NAEA;
+  // product, and S += T2
+  return kernel_cost(0.0,2.0*complex_size*MN) +
+         order*(gemm_cost(NMO,NAEA,NMO) + kernel_cost(2.0*MN,3.0*complex_size*MN));
+}
+
+/// afqmc_sys::propagate of nwalk walkers
+inline kernel_cost propagate_cost(int NMO, int NAEA, int nwalk, int order=6)
+{
+  double MM = double(NMO)*NMO;
+  // copy of vHS of the walker, then for each spin Propg*exp(vHS)*Propg
+  kernel_cost per_spin = 2.0*gemm_cost(NMO,NAEA,NMO) + apply_expM_cost(NMO,NAEA,order);
+  return double(nwalk)*(kernel_cost(0.0,2.0*complex_size*MM) + 2.0*per_spin);
+}
+
+/// afqmc_sys::calculate_mixed_density_matrix of nwalk walkers
+inline kernel_cost mixed_density_matrix_cost(int NMO, int NAEA, int nwalk, bool compact=true)
+{
+  int N_ = compact?NAEA:NMO;
+  kernel_cost per_det = gemm_cost(NAEA,NAEA,NMO) + invert_cost(NAEA) + gemm_cost(NAEA,NMO,NAEA);
+  if(!compact)
+    per_det += gemm_cost(NMO,NMO,NAEA);
+  // copy into G
+  per_det += kernel_cost(0.0,2.0*complex_size*N_*NMO);
+  return 2.0*double(nwalk)*per_det;
+}
+
+/// afqmc_sys::calculate_overlaps of nwalk walkers
+inline kernel_cost overlap_cost(int NMO, int NAEA, int nwalk)
+{
+  return 2.0*double(nwalk)*(gemm_cost(NAEA,NAEA,NMO) + getrf_cost(NAEA));
+}
+
+/// base::calculate_energy from the compact density matrix of nwalk walkers
+template<class SpMat>
+inline kernel_cost energy_cost(const SpMat& Vakbl, int nwalk)
+{
+  double n = Vakbl.rows();
+  // Vakbl*Gc, dot product with Gc and 1-body term
+  return csrmm_cost(Vakbl.size(),Vakbl.rows(),Vakbl.cols(),nwalk) +
+         kernel_cost(16.0*n*nwalk, 3.0*complex_size*n*nwalk);
+}
+
+/// Cholesky factorization of a [n][n] hermitian matrix
+inline kernel_cost potrf_cost(double n)
+{
+  return kernel_cost(4.0/3.0*n*n*n, 2.0*complex_size*n*n);
+}
+
+/// B[m][n] = B * R^(-1), R triangular [n][n]
+inline kernel_cost trsm_cost(double m, double n)
+{
+  return kernel_cost(4.0*m*n*n, complex_size*(0.5*n*n+2.0*m*n));
+}
+
+/// CholeskyQR2 of [m][n] (m>=n)
+inline kernel_cost cholqr2_cost(double m, double n)
+{
+  return 2.0*(gemm_cost(n,n,m) + potrf_cost(n) + trsm_cost(m,n));
+}
+
+/// modified Gram-Schmidt of [m][n] (m>=n)
+inline kernel_cost mgs_cost(double m, double n)
+{
+  return kernel_cost(8.0*m*n*n, 2.0*complex_size*m*n);
+}
+
+/// afqmc_sys::orthogonalize of nwalk walkers
+inline kernel_cost orthogonalize_cost(int NMO, int NAEA, int nwalk, ortho_method method=ortho_lq)
+{
+  switch(method) {
+    case ortho_cholqr2: return 2.0*double(nwalk)*cholqr2_cost(NMO,NAEA);
+    case ortho_mgs: return 2.0*double(nwalk)*mgs_cost(NMO,NAEA);
+    default: return 2.0*double(nwalk)*lq_cost(NAEA,NMO);
+  }
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file orthogonalize.hpp
+ *  @brief Orthogonalization of the columns of a Slater determinant
+ *
+ *  The [NMO][NAEA] matrix A of a walker is replaced by Q, with orthonormal columns
+ *  and A = Q*R, R upper triangular [NAEA][NAEA]. Q is only defined up to a phase per column,
+ *  which depends on the method. Observables of the walker are independent of R,
+ *  overlaps change as <T|Q> = <T|A>/det(R). All routines return log(det(R)),
+ *  accumulated from the diagonal of R so that it can not overflow.
+ *
+ *  Available methods:
+ *  - ortho_lq: Householder LQ factorization of the (column-major) transpose, gelqf + glq.
+ *    Unconditionally stable.
+ *  - ortho_cholqr2: CholeskyQR2, S = H(A)*A, S = H(R)*R, A = A*R^(-1), done twice.
+ *    One gemm, a [NAEA][NAEA] Cholesky factorization and one trsm per pass,
+ *    much cheaper than LQ when NMO >> NAEA. Fails if the condition number of A
+ *    is larger than ~1e8, in which case orthogonalize falls back to LQ.
+ *  - ortho_mgs: modified Gram-Schmidt, with the column updates done row by row on
+ *    contiguous memory so that they vectorize. No LAPACK calls, competitive for small NAEA.
+ */
+
+#ifndef  AFQMC_ORTHOGONALIZE_HPP
+#define  AFQMC_ORTHOGONALIZE_HPP
+
+#include<cmath>
+#include<complex>
+#include<algorithm>
+#include<string>
+#include "Numerics/ma_lapack.hpp"
+#include "Numerics/ma_operations.hpp"
+
+namespace qmcplusplus
+{
+
+namespace base
+{
+
+enum ortho_method
+{
+  ortho_lq,
+  ortho_cholqr2,
+  ortho_mgs
+};
+
+inline std::string ortho_name(ortho_method m)
+{
+  switch(m) {
+    case ortho_lq: return std::string("lq");
+    case ortho_cholqr2: return std::string("cholqr2");
+    case ortho_mgs: return std::string("mgs");
+  }
+  return std::string("unknown");
+}
+
+inline bool parse_ortho(const std::string& s, ortho_method& m)
+{
+  if(s == "lq") m = ortho_lq;
+  else if(s == "cholqr2") m = ortho_cholqr2;
+  else if(s == "mgs") m = ortho_mgs;
+  else return false;
+  return true;
+}
+
+// log(det(R)), from the diagonal of the triangular factor stored in R
+template<class Mat>
+inline typename std::decay<Mat>::type::element log_det_triangular(const Mat& R)
+{
+  using Type = typename std::decay<Mat>::type::element;
+  Type res = Type(0);
+  for(int i=0, n=std::min(R.shape()[0],R.shape()[1]); i<n; i++)
+    res += std::log(R[i][i]);
+  return res;
+}
+
+/**
+ * Householder orthogonalization, LQ on the direct matrix.
+ *  - TAU: [ >= NAEA ]
+ *  - WORK: capacity at least gelqf/glq_optimal_workspace_size(A)
+ * Returns log(det(R)), R = T(L).
+ */
+template< class Mat,
+          class Vec,
+          class Buffer
+        >
+inline typename std::decay<Mat>::type::element OrthogonalizeLQ(Mat&& A, Vec& TAU, Buffer& WORK)
+{
+  ma::gelqf(std::forward<Mat>(A),TAU,WORK);
+  // L is stored in the lower triangle of the (column-major) transpose, same diagonal
+  auto logdet = log_det_triangular(A);
+  ma::glq(std::forward<Mat>(A),TAU,WORK);
+  return logdet;
+}
+
+/**
+ * CholeskyQR2.
+ *  - S: [ NAEA x NAEA ] work matrix
+ *  - logdet: log(det(R)) of the passes that were completed is added to it
+ * Returns false if the Cholesky factorization fails, A is then left
+ * in a valid but non-orthogonal state (same column space).
+ */
+template< class Mat,
+          class MatS,
+          class Type
+        >
+inline bool OrthogonalizeCholQR2(Mat&& A, MatS&& S, Type& logdet)
+{
+  assert( S.shape()[0] == A.shape()[1] );
+  assert( S.shape()[1] == A.shape()[1] );
+  using ma::H;
+  for(int pass=0; pass<2; pass++) {
+    // S = H(A)*A = H(R)*R
+    ma::product(H(A),A,std::forward<MatS>(S));
+    if(ma::potrf(std::forward<MatS>(S)) != 0)
+      return false;
+    logdet += log_det_triangular(S);
+    // A = A * R^(-1)
+    ma::trsm<'R','U','N','N'>(Type(1.0),S,std::forward<Mat>(A));
+  }
+  return true;
+}
+
+/**
+ * Modified Gram-Schmidt, right-looking: once column j is normalized, its projection
+ * is removed from all the following columns.
+ *  - r: [ >= NAEA ] work vector
+ * Returns log(det(R)), R(j,j) is the norm of column j before normalization.
+ */
+template< class Mat,
+          class Vec
+        >
+inline typename std::decay<Mat>::type::element OrthogonalizeMGS(Mat&& A, Vec& r)
+{
+  using Type = typename std::decay<Mat>::type::element;
+  using RType = typename Type::value_type;
+  const int nr = A.shape()[0];
+  const int nc = A.shape()[1];
+  const int lda = A.strides()[0];
+  assert( A.strides()[1] == 1 );
+  assert( r.size() >= nc );
+  Type* a = A.origin();
+  Type* rk = r.data();
+  RType logdet = RType(0);
+  for(int j=0; j<nc; j++) {
+    RType nrm = RType(0);
+    for(int i=0; i<nr; i++)
+      nrm += std::norm(a[i*lda+j]);
+    logdet += RType(0.5)*std::log(nrm);
+    RType s = RType(1)/std::sqrt(nrm);
+    for(int i=0; i<nr; i++)
+      a[i*lda+j] *= s;
+    if(j+1 == nc) break;
+    // r(k) = H(q_j) * a_k, for k > j
+    for(int k=j+1; k<nc; k++) rk[k] = Type(0);
+    for(int i=0; i<nr; i++) {
+      const Type q = std::conj(a[i*lda+j]);
+      const Type* ai = a+i*lda;
+      #pragma omp simd
+      for(int k=j+1; k<nc; k++)
+        rk[k] += q*ai[k];
+    }
+    // a_k -= q_j * r(k)
+    for(int i=0; i<nr; i++) {
+      const Type q = a[i*lda+j];
+      Type* ai = a+i*lda;
+      #pragma omp simd
+      for(int k=j+1; k<nc; k++)
+        ai[k] -= q*rk[k];
+    }
+  }
+  return Type(logdet);
+}
+
+/**
+ * Cheap estimate of the conditioning of A: ratio of the largest to the smallest column norm.
+ * Columns of a propagated determinant grow at different rates, the ratio measures
+ * how far A is from being orthogonalized again.
+ *  - nrm: [ >= NAEA ] work vector
+ */
+template< class Mat,
+          class Vec
+        >
+inline typename Vec::value_type column_norm_ratio(const Mat& A, Vec& nrm)
+{
+  using RType = typename Vec::value_type;
+  const int nr = A.shape()[0];
+  const int nc = A.shape()[1];
+  assert( nrm.size() >= nc );
+  for(int k=0; k<nc; k++) nrm[k] = RType(0);
+  for(int i=0; i<nr; i++) {
+    auto ai = A[i].origin();
+    for(int k=0; k<nc; k++)
+      nrm[k] += std::norm(ai[k]);
+  }
+  auto mm = std::minmax_element(nrm.begin(),nrm.begin()+nc);
+  return std::sqrt(*mm.second / *mm.first);
+}
+
+} // namespace base
+
+} // namespace qmcplusplus
+
+#endif
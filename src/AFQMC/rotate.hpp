@@ -21,6 +21,7 @@
 #define  AFQMC_ROTATE_HPP 
 
 #include "Numerics/ma_operations.hpp"
+#include "Utilities/ScratchArena.h"
 
 namespace qmcplusplus
 {
@@ -83,8 +84,9 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
 
   using Type = typename SpMatB::value_type;
 
-  boost::multi_array<Type,2> An(extents[M][M]);
-  boost::multi_array<Type,2> C(extents[N][M]);
+  ScratchScope scratch;
+  auto An = scratch.matrix<Type>(M,M);
+  auto C = scratch.matrix<Type>(N,M);
   std::size_t nz=0;
   // count number of non-zero terms
 
@@ -126,7 +128,7 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
           nz++;
   }
 
-  B.resize(nz);
+  B.reserve(nz);
   // generate rotated matrix
    col = A.indx();
   val = A.val();
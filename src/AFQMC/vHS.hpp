@@ -24,6 +24,7 @@
 
 #include "Numerics/ma_operations.hpp"
 #include "Numerics/OhmmsBlas.h"
+#include "Matrix/PlanarMatrix.hpp"
 #include<iostream>
 
 namespace qmcplusplus
@@ -38,6 +39,8 @@ namespace base
  *
  * \f$    vHS(ik,w) = \sum_n Spvn(ik,n) * X(n,w) \f$
  *
+ * Spvn is any matrix accepted by ma::product, e.g. MatrixOperator.
+ *
  * Serial Implementation
  */
 template< class SpMat,
@@ -55,6 +58,22 @@ inline void get_vHS(const SpMat& Spvn, const MatA& X, MatB&& v)
   ma::product(Spvn,X,std::forward<MatB>(v));  
 }
 
+/**
+ * Same as above, with X and v in planar storage (see Matrix/PlanarMatrix.hpp).
+ * Spvn must be a MatrixOperator.
+ */
+template< class SpMat,
+          class R
+        >
+inline void get_vHS(const SpMat& Spvn, const PlanarMatrix<R>& X, PlanarMatrix<R>& v)
+{
+  using Type = std::complex<R>;
+  assert( Spvn.cols() == X.rows() );
+  assert( Spvn.rows() == v.rows() );
+  assert( X.cols() == v.cols() );
+  Spvn.product_planar('N',Type(1.),X.ref(),Type(0.),v.ref());
+}
+
 /**
  * Calculate \f$S = \exp(V)*S \f$ using a Taylor expansion of exp(V)
  */ 
@@ -73,19 +92,20 @@ inline void apply_expM( const MatA& V, MatB&& S, MatC&& T1, MatC&& T2, int order
 
   using ComplexType = typename std::decay<MatB>::type::element; 
   ComplexType zero(0.);
-  MatC& rT1 = T1;
-  MatC& rT2 = T2;
+  // the roles of T1 and T2 alternate, swapping the arrays themselves would copy them
+  typename std::decay<MatC>::type* pT1 = &T1;
+  typename std::decay<MatC>::type* pT2 = &T2;
 
   T1 = S;
   for(int n=1; n<=order; n++) {
     ComplexType fact = ComplexType(0.0,1.0)*static_cast<ComplexType>(1.0/static_cast<double>(n));
-    ma::product(fact,V,rT1,zero,rT2);
+    ma::product(fact,V,*pT1,zero,*pT2);
     // overload += ???
     // S += (*pT2); 
     for(int i=0, ie=S.shape()[0]; i<ie; i++)
      for(int j=0, je=S.shape()[1]; j<je; j++)
-      S[i][j] += rT2[i][j];
-    std::swap(rT1,rT2);
+      S[i][j] += (*pT2)[i][j];
+    std::swap(pT1,pT2);
   }
 
 }
@@ -23,6 +23,7 @@
 #define  AFQMC_VBIAS_HPP 
 
 #include "Numerics/ma_operations.hpp"
+#include "Matrix/PlanarMatrix.hpp"
 
 namespace qmcplusplus
 {
@@ -37,6 +38,8 @@ namespace base
  *
  *  \f$ vbias(n,w) = \sum_{ik} Spvn(ik,n)  G(ik,w) \f$
  * 
+ * Spvn can be a SparseMatrix or a MatrixOperator (runtime selected storage).
+ *
  * Serial Implementation
  * \todo improve template and argument names
  *
@@ -82,6 +85,32 @@ inline void get_vbias(const SpMat& Spvn, const MatA& G, MatB&& v, bool transpose
   }
 }
 
+/**
+ * Same as above, with G and v in planar storage (see Matrix/PlanarMatrix.hpp).
+ * Spvn must be a MatrixOperator.
+ */
+template<class SpMat,
+         class R
+        >
+inline void get_vbias(const SpMat& Spvn, const PlanarMatrix<R>& G, PlanarMatrix<R>& v, bool transposed)
+{
+  using Type = std::complex<R>;
+  assert( G.cols() == v.cols() );
+  if(transposed) {
+    assert( Spvn.cols() == G.rows() );
+    assert( Spvn.rows() == v.rows() );
+    Spvn.product_planar('N',Type(1.),G.ref(),Type(0.),v.ref());
+  } else {
+    assert( Spvn.rows()*2 == G.rows() );
+    assert( Spvn.cols() == v.rows() );
+    int half = G.rows()/2;
+    // alpha
+    Spvn.product_planar('T',Type(1.),G.ref().sub_rows(0,half),Type(0.),v.ref());
+    // beta
+    Spvn.product_planar('T',Type(1.),G.ref().sub_rows(half,G.rows()),Type(1.),v.ref());
+  }
+}
+
 }
 
 }
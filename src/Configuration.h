@@ -51,6 +51,7 @@
 
 #include<boost/multi_array.hpp>
 
+#include "Utilities/NumaAllocator.h"
 #include "Matrix/SparseMatrix.hpp"
 #include "Matrix/SparseMatrix_ref.hpp"
 
@@ -87,30 +88,31 @@ namespace qmcplusplus
   typedef SMDenseVector<SPComplexType>   SPComplexSMVector;
 */
 
+  // large arrays follow the global memory_policy (huge pages, NUMA placement), see NumaAllocator.h
   // [nwalk][2][NMO][NAEA]
-  typedef boost::multi_array<ValueType,4> WalkerContainer;
-
-  typedef boost::multi_array<IndexType,1> IndexVector;
-  typedef boost::multi_array<RealType,1> RealVector;
-  typedef boost::multi_array<SPRealType,1> SPRealVector;
-  typedef boost::multi_array<ValueType,1> ValueVector;
-  typedef boost::multi_array<SPValueType,1> SPValueVector;
-  typedef boost::multi_array<ComplexType,1> ComplexVector;
-  typedef boost::multi_array<SPComplexType,1> SPComplexVector;
-
-  typedef boost::multi_array<IndexType,2> IndexMatrix;  
-  typedef boost::multi_array<RealType,2> RealMatrix;  
-  typedef boost::multi_array<SPRealType,2> SPRealMatrix;  
-  typedef boost::multi_array<ValueType,2> ValueMatrix;  
-  typedef boost::multi_array<SPValueType,2> SPValueMatrix;  
-  typedef boost::multi_array<ComplexType,2> ComplexMatrix;  
-  typedef boost::multi_array<SPComplexType,2> SPComplexMatrix;  
-
-  typedef SparseMatrix<IndexType>     IndexSpMat;
-  typedef SparseMatrix<RealType>      RealSpMat;
-  typedef SparseMatrix<ValueType>     ValueSpMat;
-  typedef SparseMatrix<SPValueType>   SPValueSpMat;
-  typedef SparseMatrix<ComplexType>   ComplexSpMat;
+  typedef boost::multi_array<ValueType,4,numa_allocator<ValueType> > WalkerContainer;
+
+  typedef boost::multi_array<IndexType,1,numa_allocator<IndexType> > IndexVector;
+  typedef boost::multi_array<RealType,1,numa_allocator<RealType> > RealVector;
+  typedef boost::multi_array<SPRealType,1,numa_allocator<SPRealType> > SPRealVector;
+  typedef boost::multi_array<ValueType,1,numa_allocator<ValueType> > ValueVector;
+  typedef boost::multi_array<SPValueType,1,numa_allocator<SPValueType> > SPValueVector;
+  typedef boost::multi_array<ComplexType,1,numa_allocator<ComplexType> > ComplexVector;
+  typedef boost::multi_array<SPComplexType,1,numa_allocator<SPComplexType> > SPComplexVector;
+
+  typedef boost::multi_array<IndexType,2,numa_allocator<IndexType> > IndexMatrix;  
+  typedef boost::multi_array<RealType,2,numa_allocator<RealType> > RealMatrix;  
+  typedef boost::multi_array<SPRealType,2,numa_allocator<SPRealType> > SPRealMatrix;  
+  typedef boost::multi_array<ValueType,2,numa_allocator<ValueType> > ValueMatrix;  
+  typedef boost::multi_array<SPValueType,2,numa_allocator<SPValueType> > SPValueMatrix;  
+  typedef boost::multi_array<ComplexType,2,numa_allocator<ComplexType> > ComplexMatrix;  
+  typedef boost::multi_array<SPComplexType,2,numa_allocator<SPComplexType> > SPComplexMatrix;  
+
+  typedef SparseMatrix<IndexType,numa_allocator<IndexType> >     IndexSpMat;
+  typedef SparseMatrix<RealType,numa_allocator<RealType> >      RealSpMat;
+  typedef SparseMatrix<ValueType,numa_allocator<ValueType> >     ValueSpMat;
+  typedef SparseMatrix<SPValueType,numa_allocator<SPValueType> >   SPValueSpMat;
+  typedef SparseMatrix<ComplexType,numa_allocator<ComplexType> >   ComplexSpMat;
 /*
   typedef SMSparseMatrix<IndexType>     IndexSMSpMat;
   typedef SMSparseMatrix<RealType>      RealSMSpMat;
@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file MappedCSRMatrix.hpp
+ *  @brief Read-only CSR matrix memory-mapped from a flat binary file
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_MAPPEDCSRMATRIX_H
+#define QMCPLUSPLUS_AFQMC_MAPPEDCSRMATRIX_H
+
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<fstream>
+#include<stdint.h>
+#include<assert.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+namespace qmcplusplus
+{
+
+/**
+ * Layout of the flat CSR file, all sections start at multiples of 64 bytes:
+ *   header | vals[nnz] | cols[nnz] | rowIndex[nr+1]
+ */
+struct csr_file_header
+{
+  char magic[8];
+  uint64_t version;
+  uint64_t value_size;
+  uint64_t nr, nc, nnz;
+  uint64_t pad[2];
+};
+
+inline uint64_t csr_file_align(uint64_t n) { return (n+63)/64*64; }
+
+/**
+ * Writes the compressed CSR matrix A to fname in the flat layout read by MappedCSRMatrix.
+ * The file is written under a temporary name and renamed when complete, so
+ * processes that find the file can always map it.
+ */
+template<class SpMat>
+bool write_csr_file(const std::string& fname, const SpMat& A)
+{
+  typedef typename SpMat::value_type T;
+  assert(A.isCompressed());
+  csr_file_header h;
+  std::memset(&h,0,sizeof(h));
+  std::memcpy(h.magic,"AFQMCCSR",8);
+  h.version = 1;
+  h.value_size = sizeof(T);
+  h.nr = A.rows();
+  h.nc = A.cols();
+  h.nnz = A.size();
+  int p0 = (h.nr>0)?(*A.pntrb()):0;
+  std::vector<int> rowIndex(h.nr+1);
+  for(uint64_t i=0; i<h.nr; i++) rowIndex[i] = A.pntrb()[i]-p0;
+  rowIndex[h.nr] = static_cast<int>(h.nnz);
+  std::string tmp = fname + ".tmp";
+  std::ofstream out(tmp.c_str(),std::ios::binary);
+  if(!out) {
+    std::cerr<<" Error: Problems creating file: " <<tmp <<std::endl;
+    return false;
+  }
+  const char zeros[64] = {};
+  auto write_section = [&](const char* p, uint64_t n) {
+    out.write(p,n);
+    out.write(zeros,csr_file_align(n)-n);
+  };
+  write_section(reinterpret_cast<const char*>(&h),sizeof(h));
+  write_section(reinterpret_cast<const char*>(A.val()),h.nnz*sizeof(T));
+  write_section(reinterpret_cast<const char*>(A.indx()),h.nnz*sizeof(int));
+  write_section(reinterpret_cast<const char*>(rowIndex.data()),(h.nr+1)*sizeof(int));
+  out.close();
+  if(!out || std::rename(tmp.c_str(),fname.c_str()) != 0) {
+    std::cerr<<" Error: Problems writing file: " <<fname <<std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Compressed CSR matrix mapped read-only from a file written by write_csr_file.
+ * Pages are shared by all processes on a node mapping the same file, and are
+ * only read from disk when first accessed.
+ * Provides the accessors used by ma::product on SparseMatrix (dimensionality -2).
+ */
+template<class T>
+class MappedCSRMatrix
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef const T*     const_pointer;
+  typedef const int*   const_intPtr;
+  typedef int          intType;
+  typedef MappedCSRMatrix<T>  This_t;
+
+  const static int dimensionality = -2;
+  const static bool sparse = true;
+
+  MappedCSRMatrix<T>():base(nullptr),length(0),nr(0),nc(0),nnz(0),vals(nullptr),colms(nullptr),rowIndex(nullptr)
+  {
+  }
+
+  ~MappedCSRMatrix<T>() { unmap(); }
+
+  MappedCSRMatrix<T>(const MappedCSRMatrix<T> &rhs) = delete;
+  This_t& operator=(const MappedCSRMatrix<T> &rhs) = delete;
+
+  bool map(const std::string& fname)
+  {
+    unmap();
+    int fd = ::open(fname.c_str(),O_RDONLY);
+    if(fd < 0) {
+      std::cerr<<" Error: Problems opening file: " <<fname <<std::endl;
+      return false;
+    }
+    struct stat st;
+    csr_file_header h;
+    if(fstat(fd,&st) != 0 || st.st_size < 0 || uint64_t(st.st_size) < sizeof(h) ||
+       pread(fd,&h,sizeof(h),0) != ssize_t(sizeof(h)) ||
+       std::memcmp(h.magic,"AFQMCCSR",8) != 0 || h.version != 1 || h.value_size != sizeof(T)) {
+      std::cerr<<" Error: Invalid CSR file: " <<fname <<std::endl;
+      ::close(fd);
+      return false;
+    }
+    uint64_t o_vals = csr_file_align(sizeof(h));
+    uint64_t o_cols = o_vals + csr_file_align(h.nnz*sizeof(T));
+    uint64_t o_rows = o_cols + csr_file_align(h.nnz*sizeof(int));
+    if(uint64_t(st.st_size) < o_rows + (h.nr+1)*sizeof(int)) {
+      std::cerr<<" Error: Truncated CSR file: " <<fname <<std::endl;
+      ::close(fd);
+      return false;
+    }
+    void* p = mmap(nullptr,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p == MAP_FAILED) {
+      std::cerr<<" Error: Problems mapping file: " <<fname <<std::endl;
+      return false;
+    }
+    base = static_cast<char*>(p);
+    length = st.st_size;
+    nr = static_cast<int>(h.nr);
+    nc = static_cast<int>(h.nc);
+    nnz = h.nnz;
+    vals = reinterpret_cast<const T*>(base+o_vals);
+    colms = reinterpret_cast<const int*>(base+o_cols);
+    rowIndex = reinterpret_cast<const int*>(base+o_rows);
+    return true;
+  }
+
+  void unmap()
+  {
+    if(base != nullptr) munmap(base,length);
+    base = nullptr;
+    length = 0;
+    nr = nc = 0;
+    nnz = 0;
+    vals = nullptr;
+    colms = rowIndex = nullptr;
+  }
+
+  bool isCompressed() const { return base != nullptr; }
+  unsigned long size() const { return nnz; }
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+  // size of the mapping in bytes
+  unsigned long memory_usage() const { return length; }
+
+  const_pointer val(long n=0) const { return vals+n; }
+  const_intPtr indx(long n=0) const { return colms+n; }
+  const_intPtr pntrb(long n=0) const { return rowIndex+n; }
+  const_intPtr pntre(long n=0) const { return rowIndex+n+1; }
+
+  private:
+
+  char* base;
+  unsigned long length;
+  int nr, nc;
+  unsigned long nnz;
+  const T* vals;
+  const int* colms;
+  const int* rowIndex;
+
+};
+
+}
+
+#endif
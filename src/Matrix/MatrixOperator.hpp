@@ -0,0 +1,506 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file MatrixOperator.hpp
+ *  @brief Matrix with storage format selected at runtime
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_MATRIXOPERATOR_H
+#define QMCPLUSPLUS_AFQMC_MATRIXOPERATOR_H
+
+#include<string>
+#include<vector>
+#include<memory>
+#include<algorithm>
+#include<boost/multi_array.hpp>
+
+#include "Utilities/Clock.h"
+#include "Utilities/NumaAllocator.h"
+#include "Utilities/cache_info.hpp"
+#include "Utilities/ScratchArena.h"
+#include "Message/OpenMP.h"
+#include "Message/Communicate.h"
+#include "Matrix/SparseMatrix.hpp"
+#include "Matrix/SELLMatrix.hpp"
+#include "Matrix/MappedCSRMatrix.hpp"
+#include "Matrix/PlanarMatrix.hpp"
+#include "Numerics/ma_operations.hpp"
+
+namespace qmcplusplus
+{
+
+enum matrix_storage
+{
+  storage_csr,
+  storage_sell,
+  storage_dense,
+  storage_auto,   // chosen by select_storage
+  storage_mapped  // CSR mapped from a file, see map_csr
+};
+
+inline std::string storage_name(matrix_storage f)
+{
+  switch(f) {
+    case storage_csr: return std::string("csr");
+    case storage_sell: return std::string("sell");
+    case storage_dense: return std::string("dense");
+    case storage_auto: return std::string("auto");
+    case storage_mapped: return std::string("mapped");
+  }
+  return std::string("unknown");
+}
+
+inline bool parse_storage(const std::string& s, matrix_storage& f)
+{
+  if(s == "csr") f = storage_csr;
+  else if(s == "sell") f = storage_sell;
+  else if(s == "dense") f = storage_dense;
+  else if(s == "auto") f = storage_auto;
+  else return false;
+  return true;
+}
+
+/**
+ * Matrix used as a linear operator in ma::product, C = alpha*op(A)*B + beta*C,
+ * with the storage format chosen at runtime.
+ *
+ * Available formats: CSR (SparseMatrix), SELL-C-sigma (SELLMatrix) and dense,
+ * the latter is preferable when the matrix has a large fraction of non-zero elements.
+ * The matrix is assembled in CSR format through csr(), e.g. in afqmc::Initialize.
+ * set_storage builds the requested representation and releases the others.
+ * The CSR matrix can be kept, e.g. to compare formats with time_product.
+ * Alternatively, a CSR matrix saved with write_csr can be mapped read-only with map_csr,
+ * which allows processes on the same node to share a single copy.
+ * In-memory representations are allocated with numa_allocator, following the global memory_policy.
+ *
+ * set_replicas keeps copies of the active representation on other NUMA nodes. Products are then
+ * split over the columns of B among the threads of an OpenMP parallel region, and every thread
+ * uses the copy of the node it runs on (threads should be pinned, e.g. OMP_PROC_BIND=close).
+ *
+ * Sparse products are done in tiles of columns of B and C (walkers in the AFQMC products),
+ * so that the rows accessed in random order, those of B for op='N' and of C otherwise,
+ * fit in cache. See set_walker_tile.
+ * product_planar takes B and C in planar complex storage (see PlanarMatrix.hpp).
+ */
+template<class T>
+class MatrixOperator
+{
+  public:
+
+  typedef T            value_type;
+  typedef SparseMatrix<T,numa_allocator<T> > csr_type;
+  typedef SELLMatrix<T>  sell_type;
+  typedef boost::multi_array<T,2,numa_allocator<T> >  dense_type;
+  typedef MappedCSRMatrix<T>  mapped_type;
+
+  const static int dimensionality = -4;
+  const static bool sparse = true;
+
+  MatrixOperator<T>():fmt(storage_csr),ready(false),nr(0),nc(0),nnz(0),sell_chunk(8),sell_sigma(256),walker_tile_(0)
+  {
+  }
+
+  MatrixOperator<T>(const MatrixOperator<T> &rhs) = delete;
+  MatrixOperator<T>& operator=(const MatrixOperator<T> &rhs) = delete;
+
+  // CSR matrix, only valid before set_storage is called or if the CSR matrix is kept
+  csr_type& csr() { return csr_; }
+  const csr_type& csr() const { return csr_; }
+
+  void set_sell_parameters(int chunk, int sigma)
+  {
+    sell_chunk = chunk;
+    sell_sigma = sigma;
+  }
+
+  /**
+   * Number of columns of B and C per tile in sparse products.
+   * 0 (default): chosen so that a tile of the randomly accessed matrix, cols() rows, fits in L2,
+   * with at least 64 columns so that A is not streamed too many times.
+   * Negative: no tiling.
+   */
+  void set_walker_tile(int n)
+  {
+    walker_tile_ = n;
+    for(auto& r: replicas_) r->walker_tile_ = n;
+  }
+
+  // tile size used in products with ncol columns in B and C
+  int walker_tile(int ncol) const
+  {
+    if(walker_tile_ < 0 || fmt == storage_dense) return ncol;
+    int n = walker_tile_;
+    if(n == 0) {
+      std::size_t row = std::max(std::size_t(1),std::size_t(nc)*sizeof(T));
+      n = std::max(64,int(std::min(l2_cache_size()/row,std::size_t(ncol)))/16*16);
+    }
+    if(n >= ncol) return ncol;
+    // tiles of similar size
+    int ntiles = (ncol+n-1)/n;
+    return (ncol+ntiles-1)/ntiles;
+  }
+
+  /**
+   * Builds the representation f from the CSR matrix.
+   * If keep_csr==false, the CSR matrix is released.
+   * Representations other than f (and CSR if kept) are always released.
+   */
+  void set_storage(matrix_storage f, bool keep_csr=false)
+  {
+    if(f == storage_auto)
+      APP_ABORT(" Error: storage_auto in MatrixOperator::set_storage, use select_storage.\n");
+    if(f == storage_mapped)
+      APP_ABORT(" Error: storage_mapped in MatrixOperator::set_storage, use map_csr.\n");
+    replicas_.clear();
+    if(csr_.isCompressed()) {
+      nr = csr_.rows();
+      nc = csr_.cols();
+      nnz = csr_.size();
+    } else if(f == storage_csr || !(f == fmt && ready))
+      APP_ABORT(" Error: MatrixOperator::set_storage requires a compressed CSR matrix.\n");
+    if(f == storage_sell) {
+      if(!(fmt == storage_sell && ready)) sell_.setup(csr_,sell_chunk,sell_sigma);
+    } else
+      sell_.clear();
+    if(f == storage_dense) {
+      if(!(fmt == storage_dense && ready)) {
+        dense_.resize(boost::extents[nr][nc]);
+        std::fill_n(dense_.data(),dense_.num_elements(),T(0));
+        const int* pb = csr_.pntrb();
+        const int* pe = csr_.pntre();
+        const int* col = csr_.indx();
+        const T* val = csr_.val();
+        int p0 = (nr>0)?(*pb):0;
+        for(int i=0; i<nr; i++)
+          for(int k=pb[i]-p0; k<pe[i]-p0; k++)
+            dense_[i][col[k]] = val[k];
+      }
+    } else
+      dense_.resize(boost::extents[0][0]);
+    mapped_.unmap();
+    if(f != storage_csr && !keep_csr) {
+      csr_type empty;
+      csr_.swap(empty);
+    }
+    fmt = f;
+    ready = true;
+  }
+
+  // writes the CSR matrix to fname, to be used later with map_csr
+  bool write_csr(const std::string& fname) const
+  {
+    if(!csr_.isCompressed())
+      APP_ABORT(" Error: MatrixOperator::write_csr requires a compressed CSR matrix.\n");
+    return write_csr_file(fname,csr_);
+  }
+
+  /**
+   * Maps the CSR matrix in fname (written by write_csr) and uses it as storage.
+   * All other representations are released.
+   */
+  bool map_csr(const std::string& fname)
+  {
+    if(!mapped_.map(fname)) return false;
+    replicas_.clear();
+    nr = mapped_.rows();
+    nc = mapped_.cols();
+    nnz = mapped_.size();
+    sell_.clear();
+    dense_.resize(boost::extents[0][0]);
+    csr_type empty;
+    csr_.swap(empty);
+    fmt = storage_mapped;
+    ready = true;
+    return true;
+  }
+
+  /**
+   * Keeps n copies of the active representation (including this one), copy r on the first node k
+   * with k*n/numa_num_nodes() == r. n is limited to the number of NUMA nodes, n<=0 means one per node.
+   * Mapped storage is shared by construction and is not replicated.
+   * Returns the number of copies.
+   */
+  int set_replicas(int n)
+  {
+    int nnodes = numa_num_nodes();
+    if(n <= 0 || n > nnodes) n = nnodes;
+    if(!ready || fmt == storage_mapped) n = 1;
+    replicas_.clear();
+    for(int r=1; r<n; r++) {
+      numa_node_scope bind((r*nnodes+n-1)/n);
+      replicas_.emplace_back(new MatrixOperator<T>());
+      replicas_.back()->copy_storage(*this);
+    }
+    return n;
+  }
+
+  int num_replicas() const { return replicas_.size()+1; }
+
+  matrix_storage storage() const { return fmt; }
+
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+  // number of non-zero elements
+  unsigned long size() const { return nnz; }
+  // fraction of non-zero elements in the matrix
+  double density() const { return (nr>0 && nc>0)?double(nnz)/(double(nr)*double(nc)):0.0; }
+
+  // memory used by the active representation in bytes, per copy
+  unsigned long memory_usage() const
+  {
+    switch(fmt) {
+      case storage_sell: return sell_.memory_usage();
+      case storage_dense: return dense_.num_elements()*sizeof(T);
+      case storage_mapped: return mapped_.memory_usage();
+      default: return nnz*(sizeof(T)+sizeof(int)) + (nr+1)*sizeof(int);
+    }
+  }
+
+  // fraction of stored elements that are non-zero
+  double fill_efficiency() const
+  {
+    switch(fmt) {
+      case storage_sell: return sell_.fill_efficiency();
+      case storage_dense: return density();
+      default: return 1.0;
+    }
+  }
+
+  template<class Tp, class MatB, class MatC>
+  void product(char op, Tp alpha, const MatB& B, Tp beta, MatC&& C) const
+  {
+    if(replicas_.empty()) {
+      product_local(op,alpha,B,beta,std::forward<MatC>(C));
+      return;
+    }
+    typedef boost::multi_array_types::index_range range;
+    int ncol = C.shape()[1];
+    int n = num_replicas(), nnodes = numa_num_nodes();
+    #pragma omp parallel
+    {
+      int nt = omp_get_num_threads(), it = omp_get_thread_num();
+      int c0 = ncol*it/nt, c1 = ncol*(it+1)/nt;
+      if(c1 > c0) {
+        int r = numa_current_node()*n/nnodes;
+        const MatrixOperator<T>& A = (r == 0)?(*this):(*replicas_[r-1]);
+        A.product_local(op,alpha,B[boost::indices[range()][range(c0,c1)]],beta,
+                        C[boost::indices[range()][range(c0,c1)]]);
+      }
+    }
+  }
+
+  /**
+   * Same as product, with B and C in planar storage. T must be std::complex<R>.
+   * With dense storage, B and C are converted to interleaved complex for gemm.
+   */
+  template<class R>
+  void product_planar(char op, T alpha, planar_ref<const R> B, T beta, planar_ref<R> C) const
+  {
+    if(replicas_.empty()) {
+      product_planar_local(op,alpha,B,beta,C);
+      return;
+    }
+    int ncol = C.cols();
+    int n = num_replicas(), nnodes = numa_num_nodes();
+    #pragma omp parallel
+    {
+      int nt = omp_get_num_threads(), it = omp_get_thread_num();
+      int c0 = ncol*it/nt, c1 = ncol*(it+1)/nt;
+      if(c1 > c0) {
+        int r = numa_current_node()*n/nnodes;
+        const MatrixOperator<T>& A = (r == 0)?(*this):(*replicas_[r-1]);
+        A.product_planar_local(op,alpha,B.sub_cols(c0,c1),beta,C.sub_cols(c0,c1));
+      }
+    }
+  }
+
+  private:
+
+  // product with the local copy, in tiles of columns
+  template<class Tp, class MatB, class MatC>
+  void product_local(char op, Tp alpha, const MatB& B, Tp beta, MatC&& C) const
+  {
+    int ncol = C.shape()[1];
+    int tile = walker_tile(ncol);
+    if(tile >= ncol) {
+      product_tile(op,alpha,B,beta,std::forward<MatC>(C));
+      return;
+    }
+    typedef boost::multi_array_types::index_range range;
+    for(int c0=0; c0<ncol; c0+=tile) {
+      int c1 = std::min(ncol,c0+tile);
+      product_tile(op,alpha,B[boost::indices[range()][range(c0,c1)]],beta,
+                   C[boost::indices[range()][range(c0,c1)]]);
+    }
+  }
+
+  template<class R>
+  void product_planar_local(char op, T alpha, planar_ref<const R> B, T beta, planar_ref<R> C) const
+  {
+    int ncol = C.cols();
+    int tile = walker_tile(ncol);
+    for(int c0=0; c0<ncol; c0+=tile) {
+      int c1 = std::min(ncol,c0+tile);
+      product_planar_tile(op,alpha,B.sub_cols(c0,c1),beta,C.sub_cols(c0,c1));
+    }
+  }
+
+  template<class R>
+  void product_planar_tile(char op, T alpha, planar_ref<const R> B, T beta, planar_ref<R> C) const
+  {
+    switch(fmt) {
+      case storage_sell:
+        SPBLAS::sellmm_planar(op,nr,C.cols(),nc,alpha,sell_.chunk_size(),sell_.num_chunks(),
+                              sell_.val(),sell_.indx(),sell_.chunk_ptr(),sell_.chunk_len(),sell_.row_len(),sell_.row_perm(),
+                              B.re,B.im,B.ld,beta,C.re,C.im,C.ld);
+        break;
+      case storage_dense:
+        {
+          // BLAS boundary
+          ScratchScope scratch;
+          auto Bc = scratch.matrix<T>(B.rows(),B.cols());
+          auto Cc = scratch.matrix<T>(C.rows(),C.cols());
+          from_planar(B,Bc);
+          if(beta != T(0)) from_planar(planar_ref<const R>(C),Cc);
+          product_tile(op,alpha,Bc,beta,Cc);
+          to_planar(Cc,C);
+        }
+        break;
+      case storage_mapped:
+        SPBLAS::csrmm_planar(op,nr,C.cols(),nc,alpha,mapped_.val(),mapped_.indx(),mapped_.pntrb(),mapped_.pntre(),
+                             B.re,B.im,B.ld,beta,C.re,C.im,C.ld);
+        break;
+      default:
+        SPBLAS::csrmm_planar(op,nr,C.cols(),nc,alpha,csr_.val(),csr_.indx(),csr_.pntrb(),csr_.pntre(),
+                             B.re,B.im,B.ld,beta,C.re,C.im,C.ld);
+        break;
+    }
+  }
+
+  template<class Tp, class MatB, class MatC>
+  void product_tile(char op, Tp alpha, const MatB& B, Tp beta, MatC&& C) const
+  {
+    switch(fmt) {
+      case storage_sell:
+        if(op == 'N') ma::product(alpha,sell_,B,beta,std::forward<MatC>(C));
+        else if(op == 'T') ma::product(alpha,ma::T(sell_),B,beta,std::forward<MatC>(C));
+        else ma::product(alpha,ma::H(sell_),B,beta,std::forward<MatC>(C));
+        break;
+      case storage_dense:
+        if(op == 'N') ma::product(alpha,dense_,B,beta,std::forward<MatC>(C));
+        else if(op == 'T') ma::product(alpha,ma::T(dense_),B,beta,std::forward<MatC>(C));
+        else ma::product(alpha,ma::H(dense_),B,beta,std::forward<MatC>(C));
+        break;
+      case storage_mapped:
+        if(op == 'N') ma::product(alpha,mapped_,B,beta,std::forward<MatC>(C));
+        else if(op == 'T') ma::product(alpha,ma::T(mapped_),B,beta,std::forward<MatC>(C));
+        else ma::product(alpha,ma::H(mapped_),B,beta,std::forward<MatC>(C));
+        break;
+      default:
+        if(op == 'N') ma::product(alpha,csr_,B,beta,std::forward<MatC>(C));
+        else if(op == 'T') ma::product(alpha,ma::T(csr_),B,beta,std::forward<MatC>(C));
+        else ma::product(alpha,ma::H(csr_),B,beta,std::forward<MatC>(C));
+        break;
+    }
+  }
+
+  // copies the active representation of other, other must not be mapped
+  void copy_storage(const MatrixOperator<T>& other)
+  {
+    fmt = other.fmt;
+    ready = other.ready;
+    nr = other.nr;
+    nc = other.nc;
+    nnz = other.nnz;
+    sell_chunk = other.sell_chunk;
+    sell_sigma = other.sell_sigma;
+    walker_tile_ = other.walker_tile_;
+    if(fmt == storage_sell) sell_.copy(other.sell_);
+    else if(fmt == storage_dense) {
+      dense_.resize(boost::extents[nr][nc]);
+      dense_ = other.dense_;
+    } else csr_.copy(other.csr_);
+  }
+
+  matrix_storage fmt;
+  bool ready;
+  int nr, nc;
+  unsigned long nnz;
+  int sell_chunk, sell_sigma;
+  int walker_tile_;
+  csr_type csr_;
+  sell_type sell_;
+  dense_type dense_;
+  mapped_type mapped_;
+  // copies on other NUMA nodes, see set_replicas
+  std::vector<std::unique_ptr<MatrixOperator<T> > > replicas_;
+
+};
+
+/**
+ * Returns the average time (in seconds) of C = op(A)*B over nrep calls,
+ * with a B matrix of nrhs columns, in the current storage format of A.
+ */
+template<class T>
+double time_product(const MatrixOperator<T>& A, char op, int nrhs, int nrep=5)
+{
+  int nb = (op=='N')?A.cols():A.rows();
+  int nc = (op=='N')?A.rows():A.cols();
+  boost::multi_array<T,2> B(boost::extents[nb][nrhs]);
+  boost::multi_array<T,2> C(boost::extents[nc][nrhs]);
+  std::fill_n(B.data(),B.num_elements(),T(1.0));
+  std::fill_n(C.data(),C.num_elements(),T(0.0));
+  // warmup
+  A.product(op,T(1.0),B,T(0.0),C);
+  double t0 = cpu_clock();
+  for(int i=0; i<nrep; i++)
+    A.product(op,T(1.0),B,T(0.0),C);
+  return (cpu_clock()-t0)/std::max(nrep,1);
+}
+
+// below this density the dense storage of a matrix is not considered
+const double default_min_dense_fill = 0.1;
+
+/**
+ * Sets the storage of A to the fastest format for the products listed in ops
+ * (e.g. "NT" if A is used both as A*B and A^T*B), with nrhs columns in B.
+ * Dense storage is only tried if the density of A is at least min_dense_fill.
+ * A must still hold its CSR matrix. Returns the selected format.
+ */
+template<class T>
+matrix_storage select_storage(MatrixOperator<T>& A, const std::string& ops, int nrhs, double min_dense_fill=default_min_dense_fill, int nrep=3)
+{
+  std::vector<matrix_storage> candidates{storage_csr, storage_sell};
+  A.set_storage(storage_csr,true);
+  if(A.density() >= min_dense_fill) candidates.push_back(storage_dense);
+  matrix_storage best = storage_csr;
+  double tbest = 0.0;
+  for(auto f: candidates) {
+    A.set_storage(f,true);
+    double t = 0.0;
+    for(char op: ops)
+      t += time_product(A,op,nrhs,nrep);
+    if(f == storage_csr || t < tbest) {
+      best = f;
+      tbest = t;
+    }
+  }
+  A.set_storage(best);
+  return best;
+}
+
+}
+
+#endif
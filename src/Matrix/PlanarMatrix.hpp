@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PlanarMatrix.hpp
+ *  @brief Complex matrix with split (planar) storage of the real and imaginary parts
+ *
+ *  Used for the dense walker-indexed matrices (density matrix, bias potential, X, vHS)
+ *  in the sparse products, where the planar layout allows the complex multiply-add
+ *  to vectorize without shuffles. Matrices are converted to interleaved std::complex
+ *  only where they are passed to BLAS/LAPACK, with to_planar/from_planar.
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_PLANARMATRIX_H
+#define QMCPLUSPLUS_AFQMC_PLANARMATRIX_H
+
+#include<complex>
+#include<algorithm>
+#include<assert.h>
+
+#include "Utilities/NumaAllocator.h"
+
+namespace qmcplusplus
+{
+
+/**
+ * Non-owning view of a planar matrix: element (i,j) is re[i*ld+j] + i*im[i*ld+j].
+ */
+template<class T>
+struct planar_ref
+{
+  T* re;
+  T* im;
+  int nr;
+  int nc;
+  int ld;
+
+  planar_ref(T* r, T* i, int n, int m, int l):re(r),im(i),nr(n),nc(m),ld(l) {}
+
+  template<class U>
+  planar_ref(const planar_ref<U>& other):re(other.re),im(other.im),nr(other.nr),nc(other.nc),ld(other.ld) {}
+
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+
+  // rows [r0,r1)
+  planar_ref<T> sub_rows(int r0, int r1) const { return planar_ref<T>(re+r0*ld,im+r0*ld,r1-r0,nc,ld); }
+  // columns [c0,c1)
+  planar_ref<T> sub_cols(int c0, int c1) const { return planar_ref<T>(re+c0,im+c0,nr,c1-c0,ld); }
+};
+
+/**
+ * Complex [nr][nc] matrix with real type T, stored as a real plane followed by an imaginary plane.
+ */
+template<class T>
+class PlanarMatrix
+{
+  public:
+
+  typedef T real_type;
+  typedef std::complex<T> value_type;
+
+  PlanarMatrix():nr(0),nc(0) {}
+  PlanarMatrix(int n, int m):nr(0),nc(0) { resize(n,m); }
+
+  void resize(int n, int m)
+  {
+    nr = n;
+    nc = m;
+    data.assign(2*std::size_t(n)*m,T(0));
+  }
+
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+
+  T* real(int i=0) { return data.data()+std::size_t(i)*nc; }
+  T* imag(int i=0) { return data.data()+(std::size_t(nr)+i)*nc; }
+  const T* real(int i=0) const { return data.data()+std::size_t(i)*nc; }
+  const T* imag(int i=0) const { return data.data()+(std::size_t(nr)+i)*nc; }
+
+  planar_ref<T> ref() { return planar_ref<T>(real(),imag(),nr,nc,nc); }
+  planar_ref<const T> ref() const { return planar_ref<const T>(real(),imag(),nr,nc,nc); }
+
+  private:
+
+  int nr, nc;
+  numa_vector<T> data;
+
+};
+
+// P = A, A is a complex [nr][nc] matrix with unit stride in the second dimension
+template<class Mat, class T>
+inline void to_planar(const Mat& A, planar_ref<T> P)
+{
+  assert( A.shape()[0] == P.nr && A.shape()[1] == P.nc );
+  assert( A.strides()[1] == 1 );
+  for(int i=0; i<P.nr; i++) {
+    const T* a = reinterpret_cast<const T*>(A[i].origin());
+    T* pr = P.re+i*P.ld;
+    T* pi = P.im+i*P.ld;
+    #pragma omp simd
+    for(int j=0; j<P.nc; j++) {
+      pr[j] = a[2*j];
+      pi[j] = a[2*j+1];
+    }
+  }
+}
+
+// A = P
+template<class Mat, class T>
+inline void from_planar(planar_ref<const T> P, Mat&& A)
+{
+  assert( A.shape()[0] == P.nr && A.shape()[1] == P.nc );
+  assert( A.strides()[1] == 1 );
+  for(int i=0; i<P.nr; i++) {
+    T* a = reinterpret_cast<T*>(A[i].origin());
+    const T* pr = P.re+i*P.ld;
+    const T* pi = P.im+i*P.ld;
+    #pragma omp simd
+    for(int j=0; j<P.nc; j++) {
+      a[2*j] = pr[j];
+      a[2*j+1] = pi[j];
+    }
+  }
+}
+
+template<class Mat, class T>
+inline void to_planar(const Mat& A, PlanarMatrix<T>& P) { to_planar(A,P.ref()); }
+
+template<class Mat, class T>
+inline void from_planar(const PlanarMatrix<T>& P, Mat&& A) { from_planar(P.ref(),std::forward<Mat>(A)); }
+
+}
+
+#endif
@@ -0,0 +1,200 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file SELLMatrix.hpp
+ *  @brief Sparse matrix in sliced ELLPACK (SELL-C-sigma) format
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_SELLMATRIX_H
+#define QMCPLUSPLUS_AFQMC_SELLMATRIX_H
+
+#include<vector>
+#include<numeric>
+#include<algorithm>
+#include<assert.h>
+
+#include "Utilities/NumaAllocator.h"
+
+namespace qmcplusplus
+{
+
+/**
+ * Sparse matrix in SELL-C-sigma format.
+ *
+ * Rows are sorted by decreasing number of non-zero elements within windows of
+ * sigma consecutive rows and are then grouped in chunks of C rows.
+ * Each chunk is stored column-major and padded to the length of its longest row,
+ * so element j of the r-th row in chunk k is located at chunk_ptr[k] + j*C + r.
+ * Padded entries have a zero value and a valid column index.
+ * The (sorted) row in position r of chunk k is row_perm[k*C+r] and has row_len[k*C+r]
+ * non-zero elements, rows beyond the end of the matrix are marked with -1 and have length 0.
+ *
+ * The matrix is read-only, it is built from a compressed SparseMatrix (or any class
+ * providing the MKL style accessors rows/cols/val/indx/pntrb/pntre).
+ */
+template<class T>
+class SELLMatrix
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef T*           pointer;
+  typedef const T*     const_pointer;
+  typedef const int*   const_intPtr;
+  typedef int          intType;
+  typedef SELLMatrix<T>  This_t;
+
+  const static int dimensionality = -3;
+  const static bool sparse = true;
+
+  SELLMatrix<T>():nr(0),nc(0),nnz(0),C(8),sigma(1)
+  {
+  }
+
+  SELLMatrix<T>(const SELLMatrix<T> &rhs) = delete;
+  This_t& operator=(const SELLMatrix<T> &rhs) = delete;
+
+  /**
+   * Builds the SELL-C-sigma representation of A.
+   * @param A  compressed CSR matrix
+   * @param chunk  number of rows per chunk (C)
+   * @param sigma_  size of the sorting window in rows, rounded up to a multiple of chunk
+   */
+  template<class SpMat>
+  void setup(const SpMat& A, int chunk=8, int sigma_=256)
+  {
+    assert(chunk > 0);
+    assert(A.isCompressed());
+    nr = A.rows();
+    nc = A.cols();
+    C = chunk;
+    sigma = std::max(1,(sigma_+C-1)/C)*C;
+    nnz = A.size();
+    int nchunks = (nr+C-1)/C;
+    const int* pb = A.pntrb();
+    const int* pe = A.pntre();
+    int p0 = (nr>0)?(*pb):0;
+
+    // sort rows by length within each window
+    perm.resize(nchunks*C);
+    std::iota(perm.begin(),perm.begin()+nr,0);
+    std::fill(perm.begin()+nr,perm.end(),-1);
+    for(int r0=0; r0<nr; r0+=sigma)
+      std::stable_sort(perm.begin()+r0,perm.begin()+std::min(nr,r0+sigma),
+        [&](int a, int b) {return (pe[a]-pb[a]) > (pe[b]-pb[b]);});
+
+    rlen.resize(nchunks*C);
+    for(int r=0; r<nchunks*C; r++)
+      rlen[r] = (perm[r]>=0)?(pe[perm[r]]-pb[perm[r]]):0;
+
+    cptr.resize(nchunks+1);
+    clen.resize(nchunks);
+    cptr[0]=0;
+    for(int k=0; k<nchunks; k++) {
+      int len=0;
+      for(int r=0; r<C; r++)
+        len = std::max(len,rlen[k*C+r]);
+      clen[k] = len;
+      cptr[k+1] = cptr[k] + len*C;
+    }
+
+    vals.resize(cptr[nchunks]);
+    colms.resize(cptr[nchunks]);
+    for(int k=0; k<nchunks; k++) {
+      for(int r=0; r<C; r++) {
+        int row = perm[k*C+r];
+        int n = (row>=0)?(pe[row]-pb[row]):0;
+        const T* Av = A.val() + ((row>=0)?(pb[row]-p0):0);
+        const int* Ac = A.indx() + ((row>=0)?(pb[row]-p0):0);
+        int cpad = (n>0)?Ac[n-1]:0;
+        for(int j=0; j<clen[k]; j++) {
+          vals[cptr[k]+j*C+r] = (j<n)?Av[j]:T(0);
+          colms[cptr[k]+j*C+r] = (j<n)?Ac[j]:cpad;
+        }
+      }
+    }
+  }
+
+  // deep copy, e.g. to replicate the matrix on another NUMA node
+  void copy(const SELLMatrix<T>& other)
+  {
+    nr = other.nr;
+    nc = other.nc;
+    nnz = other.nnz;
+    C = other.C;
+    sigma = other.sigma;
+    vals = other.vals;
+    colms = other.colms;
+    cptr = other.cptr;
+    clen = other.clen;
+    rlen = other.rlen;
+    perm = other.perm;
+  }
+
+  void clear()
+  {
+    numa_vector<T>().swap(vals);
+    numa_vector<int>().swap(colms);
+    std::vector<int>().swap(cptr);
+    std::vector<int>().swap(clen);
+    std::vector<int>().swap(rlen);
+    std::vector<int>().swap(perm);
+    nr=nc=0;
+    nnz=0;
+  }
+
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+  // number of non-zero elements of the original matrix
+  unsigned long size() const { return nnz; }
+  // number of stored elements, including padding
+  unsigned long storage_size() const { return vals.size(); }
+  // fraction of stored elements that are non-zero
+  double fill_efficiency() const { return (vals.size()>0)?double(nnz)/double(vals.size()):1.0; }
+  unsigned long memory_usage() const
+  {
+    return vals.size()*(sizeof(T)+sizeof(int)) + (cptr.size()+clen.size()+rlen.size()+perm.size())*sizeof(int);
+  }
+
+  int chunk_size() const { return C; }
+  int num_chunks() const { return static_cast<int>(clen.size()); }
+  int sort_window() const { return sigma; }
+
+  const_pointer val() const { return vals.data(); }
+  const_intPtr indx() const { return colms.data(); }
+  const_intPtr chunk_ptr() const { return cptr.data(); }
+  const_intPtr chunk_len() const { return clen.data(); }
+  const_intPtr row_len() const { return rlen.data(); }
+  const_intPtr row_perm() const { return perm.data(); }
+
+  private:
+
+  int nr,nc;
+  unsigned long nnz;
+  int C, sigma;
+  // streamed in every product, see NumaAllocator.h
+  numa_vector<T> vals;
+  numa_vector<int> colms;
+  std::vector<int> cptr;
+  std::vector<int> clen;
+  std::vector<int> rlen;
+  std::vector<int> perm;
+
+};
+
+}
+
+#endif
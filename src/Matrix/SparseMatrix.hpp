@@ -19,6 +19,7 @@
 #include<utility>
 #include<iostream>
 #include<vector>
+#include<memory>
 #include<tuple>
 #include<assert.h>
 #include<algorithm>
@@ -32,7 +33,8 @@ namespace qmcplusplus
 {
 
 // class that implements a sparse matrix in CSR format
-template<class T>
+// Alloc is used for the arrays of values and indexes, e.g. numa_allocator<T> for the hamiltonian
+template<class T, class Alloc = std::allocator<T> >
 class SparseMatrix
 {
   public:
@@ -45,29 +47,31 @@ class SparseMatrix
   typedef const int*   const_intPtr;
   typedef int           intType;
   typedef int*           intPtr;
-  typedef typename std::vector<T>::iterator iterator;
-  typedef typename std::vector<T>::const_iterator const_iterator;
-  typedef typename std::vector<intType>::iterator int_iterator;
-  typedef typename std::vector<intType>::const_iterator const_int_iterator;
-  typedef SparseMatrix<T>  This_t;
+  typedef std::vector<T,Alloc> vals_type;
+  typedef std::vector<intType,typename std::allocator_traits<Alloc>::template rebind_alloc<intType> > ints_type;
+  typedef typename vals_type::iterator iterator;
+  typedef typename vals_type::const_iterator const_iterator;
+  typedef typename ints_type::iterator int_iterator;
+  typedef typename ints_type::const_iterator const_int_iterator;
+  typedef SparseMatrix<T,Alloc>  This_t;
 
   const static int dimensionality = -2;
   const static bool sparse = true;
   const static bool SHM = false;
 
-  SparseMatrix<T>():vals(),colms(),myrows(),rowIndex(),nr(0),nc(0),compressed(false),zero_based(true),row_offset(0),col_offset(0)
+  SparseMatrix():vals(),colms(),myrows(),rowIndex(),nr(0),nc(0),compressed(false),zero_based(true),row_offset(0),col_offset(0)
   {
   }
 
-  SparseMatrix<T>(int n,int m):vals(),colms(),myrows(),rowIndex(),nr(n),nc(m),compressed(false),zero_based(true),row_offset(0),col_offset(0)
+  SparseMatrix(int n,int m):vals(),colms(),myrows(),rowIndex(),nr(n),nc(m),compressed(false),zero_based(true),row_offset(0),col_offset(0)
   {
   }
 
-  ~SparseMatrix<T>()
+  ~SparseMatrix()
   {
   }
 
-  SparseMatrix<T>(const SparseMatrix<T> &rhs) = delete;
+  SparseMatrix(const SparseMatrix &rhs) = delete;
 
   void reserve(unsigned long n)
   {
@@ -94,6 +98,35 @@ class SparseMatrix
     zero_based=true;
   }
 
+  void swap(SparseMatrix& other)
+  {
+    vals.swap(other.vals);
+    colms.swap(other.colms);
+    myrows.swap(other.myrows);
+    rowIndex.swap(other.rowIndex);
+    std::swap(nr,other.nr);
+    std::swap(nc,other.nc);
+    std::swap(compressed,other.compressed);
+    std::swap(zero_based,other.zero_based);
+    std::swap(row_offset,other.row_offset);
+    std::swap(col_offset,other.col_offset);
+  }
+
+  // deep copy, e.g. to replicate a read-only matrix on another NUMA node
+  void copy(const SparseMatrix& other)
+  {
+    vals = other.vals;
+    colms = other.colms;
+    myrows = other.myrows;
+    rowIndex = other.rowIndex;
+    nr = other.nr;
+    nc = other.nc;
+    compressed = other.compressed;
+    zero_based = other.zero_based;
+    row_offset = other.row_offset;
+    col_offset = other.col_offset;
+  }
+
   // does nothing, needed for compatibility with shared memory version
   void setup(bool hd=true, std::string ii=std::string(""), MPI_Comm comm_=MPI_COMM_SELF) {}
 
@@ -233,7 +266,7 @@ class SparseMatrix
   }
   // ******************************************
 
-  This_t& operator=(const SparseMatrix<T> &rhs) = delete; 
+  This_t& operator=(const SparseMatrix &rhs) = delete; 
 
   // should be using binary search, but this should not be used in performance critical 
   // areas in any case
@@ -391,34 +424,34 @@ class SparseMatrix
 
   void transpose() {
     assert(myrows.size() == colms.size() && myrows.size() == vals.size());
-    for(std::vector<intType>::iterator itR=myrows.begin(),itC=colms.begin(); itR!=myrows.end(); ++itR,++itC)
+    for(int_iterator itR=myrows.begin(),itC=colms.begin(); itR!=myrows.end(); ++itR,++itC)
       std::swap(*itR,*itC);
     std::swap(nr,nc);
     compress();
   }
 
-  SparseMatrix<T>& operator*=(const double rhs ) 
+  SparseMatrix& operator*=(const double rhs ) 
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= rhs;
     return *this; 
   }
 
-  SparseMatrix<T>& operator*=(const std::complex<double> rhs ) 
+  SparseMatrix& operator*=(const std::complex<double> rhs ) 
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= rhs;
     return *this; 
   }
 
-  SparseMatrix<T>& operator*=(const float rhs )  
+  SparseMatrix& operator*=(const float rhs )  
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= T(rhs);
     return *this;
   }
 
-  SparseMatrix<T>& operator*=(const std::complex<float> rhs )  
+  SparseMatrix& operator*=(const std::complex<float> rhs )  
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= T(rhs);
@@ -441,7 +474,7 @@ class SparseMatrix
     for (intType& i : rowIndex ) i++; 
   }
 
-  friend std::ostream& operator<<(std::ostream& out, const SparseMatrix<T>& rhs)
+  friend std::ostream& operator<<(std::ostream& out, const SparseMatrix& rhs)
   {
     for(unsigned long i=0; i<rhs.vals.size(); i++)
       out<<"(" <<rhs.myrows[i] <<"," <<rhs.colms[i] <<":" <<rhs.vals[i] <<")\n"; 
@@ -450,10 +483,10 @@ class SparseMatrix
 
   // this is ugly, but I need to code quickly 
   // so I'm doing this to avoid adding hdf5 support here 
-  std::vector<T>* getVals() { return &vals; } 
-  std::vector<intType>* getRows() { return &myrows; }
-  std::vector<intType>* getCols() { return &colms; }
-  std::vector<intType>* getRowIndex() { return &rowIndex; }
+  vals_type* getVals() { return &vals; } 
+  ints_type* getRows() { return &myrows; }
+  ints_type* getCols() { return &colms; }
+  ints_type* getRowIndex() { return &rowIndex; }
 
   iterator vals_begin() { return vals.begin(); }
   int_iterator rows_begin() { return myrows.begin(); }
@@ -486,8 +519,8 @@ class SparseMatrix
   bool compressed;
   int nr,nc;
   intType row_offset, col_offset;
-  std::vector<T> vals;
-  std::vector<intType> colms,myrows,rowIndex;
+  vals_type vals;
+  ints_type colms,myrows,rowIndex;
   bool zero_based;
   Type_t zero; // zero for return value
 
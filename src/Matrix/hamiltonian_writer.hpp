@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file hamiltonian_writer.hpp
+ *  @brief Writes the hamiltonian in afqmc.h5 format with chunked (and compressed) datasets
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_HAMILTONIAN_WRITER_HPP
+#define QMCPLUSPLUS_AFQMC_HAMILTONIAN_WRITER_HPP
+
+#include<cmath>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<algorithm>
+
+#include "Configuration.h"
+#include "io/hdf_archive.h"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+/**
+ * Layout of the large datasets:
+ *  - block_size: number of terms in each Spvn_index_i/Spvn_vals_i block.
+ *    Blocks are the unit of work when reading in parallel, so there should be
+ *    several blocks per reader.
+ *  - chunk_size: number of elements in each hdf5 chunk (a multiple of it is read at once).
+ *  - compression: deflate level (0: no compression, 1-9)
+ */
+struct hamiltonian_layout
+{
+  long block_size = 1l<<20;
+  long chunk_size = 1l<<16;
+  int compression = 0;
+};
+
+/**
+ * Copies dataset aname of n elements from in to out, in pieces of at most
+ * buffer_size elements. The new dataset is chunked according to layout.
+ */
+template<typename T>
+inline bool copy_dataset(hdf_archive& in, hdf_archive& out, const std::string& aname, long n,
+                         const hamiltonian_layout& layout, long buffer_size)
+{
+  if(!out.create_chunked<T>(aname,n,layout.chunk_size,layout.compression)) return false;
+  std::vector<T> buff(std::max(1l,std::min(n,buffer_size)));
+  for(long i=0; i<n; i+=buffer_size) {
+    long m = std::min(n-i,buffer_size);
+    if(!in.read_strided(buff.data(),aname,m,i)) return false;
+    if(!out.write_strided(buff.data(),aname,m,i)) return false;
+  }
+  return true;
+}
+
+/**
+ * Copies the hamiltonian in in (afqmc.h5 format, as read by afqmc::Initialize)
+ * into out, with the layout given by layout. Spvn is split into new blocks of
+ * layout.block_size terms. Memory use is bounded by O(block_size),
+ * independently of the size of the hamiltonian.
+ * Only the datasets used by the miniapp are copied.
+ */
+inline bool rewrite_hamiltonian(hdf_archive& in, hdf_archive& out, const hamiltonian_layout& layout)
+{
+  const long bs = std::max(1l,layout.block_size);
+
+  // wavefunction and half-rotated hamiltonian
+  if(!in.is_group( std::string("/Wavefunctions/PureSingleDeterminant") )) {
+    std::cerr<<" Error: H5Group /Wavefunctions/PureSingleDeterminant does not exist. \n";
+    return false;
+  }
+  in.push("Wavefunctions",false);
+  in.push("PureSingleDeterminant",false);
+  out.push("Wavefunctions");
+  out.push("PureSingleDeterminant");
+  std::vector<int> Idata(8);
+  if(!in.read(Idata,"dims")) return false;
+  if(!out.write(Idata,"dims")) return false;
+  int NMO = Idata[4];
+  int NAEA = Idata[5];
+  {
+    std::vector<IndexType> ivec;
+    std::vector<ValueType> vvec;
+    if(!in.read(ivec,"hij_indx") || !in.read(vvec,"hij")) return false;
+    if(!out.write(ivec,"hij_indx") || !out.write(vvec,"hij")) return false;
+  }
+  if(!copy_dataset<ValueType>(in,out,"Wavefun",long(2)*NMO*NAEA,layout,bs)) return false;
+  if(!copy_dataset<ValueType>(in,out,"SpHijkl_vals",Idata[1],layout,bs)) return false;
+  if(!copy_dataset<IndexType>(in,out,"SpHijkl_cols",Idata[1],layout,bs)) return false;
+  if(!copy_dataset<IndexType>(in,out,"SpHijkl_rowIndex",long(Idata[2])+1,layout,bs)) return false;
+  in.pop();
+  in.pop();
+  out.pop();
+  out.pop();
+
+  // propagator
+  if(!in.is_group( std::string("/Propagators/phaseless_ImpSamp_ForceBias") )) {
+    std::cerr<<" Error: H5Group /Propagators/phaseless_ImpSamp_ForceBias does not exist. \n";
+    return false;
+  }
+  in.push("Propagators",false);
+  in.push("phaseless_ImpSamp_ForceBias",false);
+  out.push("Propagators");
+  out.push("phaseless_ImpSamp_ForceBias");
+  std::vector<long> Ldims(5);
+  if(!in.read(Ldims,"Spvn_dims")) return false;
+  long ntot = Ldims[0];
+  int nblk = int(Ldims[4]);
+  if(!copy_dataset<ValueType>(in,out,"Spvn_propg1",long(NMO)*NMO,layout,bs)) return false;
+  std::vector<int> counts(nblk);
+  if(!in.read(counts,"Spvn_block_sizes")) return false;
+
+  // reblock Spvn: terms are copied in order into blocks of bs terms
+  int nblk_new = int((ntot+bs-1)/bs);
+  std::vector<int> counts_new(nblk_new);
+  for(int i=0; i<nblk_new; i++)
+    counts_new[i] = int(std::min(bs,ntot-i*bs));
+  std::vector<IndexType> ivec(2*std::min(bs,std::max(ntot,1l)));
+  std::vector<ValueType> vvec(std::min(bs,std::max(ntot,1l)));
+  long nout = 0, nfill = 0;
+  auto write_block = [&]() {
+    std::string id = std::to_string(nout);
+    bool ok = out.create_chunked<IndexType>(std::string("Spvn_index_")+id,2*nfill,2*layout.chunk_size,layout.compression) &&
+              out.write_strided(ivec.data(),std::string("Spvn_index_")+id,2*nfill) &&
+              out.create_chunked<ValueType>(std::string("Spvn_vals_")+id,nfill,layout.chunk_size,layout.compression) &&
+              out.write_strided(vvec.data(),std::string("Spvn_vals_")+id,nfill);
+    nout++;
+    nfill = 0;
+    return ok;
+  };
+  for(int i=0; i<nblk; i++) {
+    std::string id = std::to_string(i);
+    for(long k=0; k<counts[i]; ) {
+      long m = std::min(long(counts[i])-k,bs-nfill);
+      if(!in.read_strided(ivec.data()+2*nfill,std::string("Spvn_index_")+id,2*m,2*k)) return false;
+      if(!in.read_strided(vvec.data()+nfill,std::string("Spvn_vals_")+id,m,k)) return false;
+      nfill += m;
+      k += m;
+      if(nfill == bs && !write_block()) return false;
+    }
+  }
+  if(nfill > 0 && !write_block()) return false;
+  if(nout != nblk_new) {
+    std::cerr<<" Error: Inconsistent Spvn_block_sizes. \n";
+    return false;
+  }
+  Ldims[4] = nblk_new;
+  if(!out.write(Ldims,"Spvn_dims")) return false;
+  if(!out.write(counts_new,"Spvn_block_sizes")) return false;
+  in.pop();
+  in.pop();
+  out.pop();
+  out.pop();
+  return true;
+}
+
+/**
+ * Writes the half-rotated Cholesky matrix (from base::halfrotate_cholesky) in CSR format,
+ * so it does not need to be calculated at startup, see afqmc::read_SpvnT.
+ * SpvnT was calculated from Spvn scaled by sqrt(dt), it is stored unscaled, as Spvn.
+ */
+template<class SpMat>
+inline bool write_SpvnT(hdf_archive& out, const SpMat& SpvnT, double dt, const hamiltonian_layout& layout)
+{
+  typedef typename SpMat::value_type T;
+  long nnz = SpvnT.size();
+  int nr = SpvnT.rows();
+  std::vector<long> Ldims{nnz, long(nr), long(SpvnT.cols())};
+  std::vector<T> vals(SpvnT.val(),SpvnT.val()+nnz);
+  for(auto& v: vals) v /= std::sqrt(dt);
+  std::vector<int> rowIndex(nr+1);
+  int p0 = (nr>0)?(*SpvnT.pntrb()):0;
+  for(int i=0; i<nr; i++) rowIndex[i] = SpvnT.pntrb()[i]-p0;
+  rowIndex[nr] = static_cast<int>(nnz);
+  out.push("Propagators");
+  out.push("phaseless_ImpSamp_ForceBias");
+  bool ok = out.write(Ldims,"SpvnT_dims") &&
+            out.create_chunked<T>("SpvnT_vals",nnz,layout.chunk_size,layout.compression) &&
+            out.write_strided(vals.data(),"SpvnT_vals",nnz) &&
+            out.create_chunked<int>("SpvnT_cols",nnz,layout.chunk_size,layout.compression) &&
+            out.write_strided(SpvnT.indx(),"SpvnT_cols",nnz) &&
+            out.create_chunked<int>("SpvnT_rowIndex",nr+1,layout.chunk_size,layout.compression) &&
+            out.write_strided(rowIndex.data(),"SpvnT_rowIndex",nr+1);
+  out.pop();
+  out.pop();
+  return ok;
+}
+
+}  // afqmc
+
+} // qmcplusplus
+
+#endif
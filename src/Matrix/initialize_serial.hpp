@@ -20,11 +20,15 @@
 
 #include<string>
 #include<vector>
+#include<numeric>
+#include<utility>
+#include<algorithm>
 
 #include "Configuration.h"
 #include "io/hdf_archive.h"
 
 #include "AFQMC/afqmc_sys.hpp"
+#include "Utilities/balanced_partition.hpp"
 
 namespace qmcplusplus
 {
@@ -32,9 +36,95 @@ namespace qmcplusplus
 namespace afqmc
 {
 
+/**
+ * Range of terms [t0,t1) of Spvn read by partition ipart (e.g. a rank or a core in a task group)
+ * out of nparts in the distributed loading mode. Terms are numbered in the order in which they
+ * appear in the blocks Spvn_index_i/Spvn_vals_i, with counts[i] terms in block i.
+ * If there are at least as many (non-empty) blocks as partitions, partitions consist of complete
+ * blocks, balanced with balance_partition_ordered_set. Otherwise blocks are split evenly.
+ */
+inline std::pair<long,long> Spvn_partition(const std::vector<int>& counts, int nparts, int ipart)
+{
+  int nblk = counts.size();
+  std::vector<long> indx(nblk+1,0);
+  for(int i=0; i<nblk; i++) indx[i+1] = indx[i]+counts[i];
+  long ntot = indx[nblk];
+  if(nparts <= 1 || ntot == 0) return {0,ntot};
+  if(std::count_if(counts.begin(),counts.end(),[](int c) { return c>0; }) >= nparts) {
+    std::vector<long> subsets(nparts+1);
+    balance_partition_ordered_set(nblk,indx.data(),subsets);
+    return {indx[subsets[ipart]],indx[subsets[ipart+1]]};
+  }
+  return {ntot*ipart/nparts,ntot*(ipart+1)/nparts};
+}
+
+/**
+ * Reads terms [t0,t1) of Spvn into rows/cols/vals, with hyperslab reads of the blocks that
+ * overlap the range, so only the requested terms are read from the file.
+ * The group /Propagators/phaseless_ImpSamp_ForceBias must be open.
+ */
+template< typename T >
+inline bool read_Spvn_terms(hdf_archive& dump, const std::vector<int>& counts, long t0, long t1, int* rows, int* cols, T* vals)
+{
+  long b0 = 0;
+  for(size_t i=0; i<counts.size(); b0+=counts[i], i++) {
+    long lo = std::max(t0,b0), hi = std::min(t1,b0+counts[i]);
+    if(lo >= hi) continue;
+    long m = hi-lo, k = lo-b0, n = lo-t0;
+    // Spvn_index_i holds (row,col) pairs, rows and columns are read with stride 2.
+    std::string id = std::to_string(i);
+    if(!dump.read_strided(rows+n,std::string("Spvn_index_")+id,m,2*k,2)) return false;
+    if(!dump.read_strided(cols+n,std::string("Spvn_index_")+id,m,2*k+1,2)) return false;
+    if(!dump.read_strided(vals+n,std::string("Spvn_vals_")+id,m,k)) return false;
+  }
+  return true;
+}
+
+/**
+ * Distributed loading mode: reads into Spvn only the terms of partition ipart out of nparts
+ * (see Spvn_partition), so the total amount of data read is independent of nparts.
+ * Spvn has the dimensions of the full matrix and sum_p Spvn(p) is the full matrix,
+ * so products with Spvn (e.g. vHS and vbias) are obtained by reducing the partial products.
+ */
+template< class SpMat >
+inline bool read_Spvn_partition(hdf_archive& dump, const double dt, SpMat& Spvn, int nparts, int ipart)
+{
+  if(!dump.is_group( std::string("/Propagators/phaseless_ImpSamp_ForceBias") )) {
+    app_error()<<" ERROR: H5Group /Propagators/phaseless_ImpSamp_ForceBias does not exist. \n";
+    return false;
+  }
+  dump.push("Propagators",false);
+  dump.push("phaseless_ImpSamp_ForceBias",false);
+  std::vector<long> Ldims(5);
+  bool ok = dump.read(Ldims,"Spvn_dims");
+  std::vector<int> counts(ok?Ldims[4]:0);
+  ok = ok && dump.read(counts,"Spvn_block_sizes");
+  if(ok && std::accumulate(counts.begin(),counts.end(),long(0)) != Ldims[0]) {
+    std::cerr<<" Inconsistent Spvn_block_sizes. " <<std::endl;
+    ok = false;
+  }
+  if(ok) {
+    std::pair<long,long> t = Spvn_partition(counts,nparts,ipart);
+    Spvn.setDims(int(Ldims[1]),int(Ldims[2]));
+    Spvn.resize(t.second-t.first);
+    ok = read_Spvn_terms(dump,counts,t.first,t.second,Spvn.row_data(),Spvn.column_data(),Spvn.values());
+  }
+  dump.pop();
+  dump.pop();
+  if(!ok) return false;
+  if(Spvn.size() > 0) Spvn.compress();
+  Spvn *= std::sqrt(dt);
+  return true;
+}
+
+/*
+ * If nparts > 1, the Spvn terms are read as nparts partitions with read_Spvn_partition, one
+ * after the other, exactly as nparts ranks would read them in the distributed mode. The result
+ * is independent of nparts.
+ */
 template< class SpMat,
           class Mat>
-inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys, Mat& Propg1, SpMat& Spvn, Mat& haj, SpMat& Vakbl)
+inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys, Mat& Propg1, SpMat& Spvn, Mat& haj, SpMat& Vakbl, bool read_2body=true, int nparts=1)
 {
   int NMO, NAEA;
 
@@ -110,61 +200,64 @@ inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys,
   // read trial wave function.
   // trial[i][j] written as a continuous array in C-format
   // i:[0,2*NMO) , j:[0,NAEA)
-  if(!dump.read(vvec,"Wavefun")) return false;
-  if(vvec.size() != 2*NMO*NAEA) {
+  // read directly into the final storage 
+  sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
+  sys.trialwfn_beta.resize(extents[NMO][NAEA]);
+  if(!dump.read_strided(sys.trialwfn_alpha.data(),"Wavefun",NMO*NAEA,0) ||
+     !dump.read_strided(sys.trialwfn_beta.data(),"Wavefun",NMO*NAEA,NMO*NAEA)) {
     std::cerr<<" Inconsistent dimensions in Wavefun. " <<std::endl;
     return false;
   }
-  sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
-  sys.trialwfn_beta.resize(extents[NMO][NAEA]);
-  int ij=0;
   for(int i=0; i<NMO; i++)
-   for(int j=0; j<NAEA; j++, ij++) {
+   for(int j=0; j<NAEA; j++) {
     using std::conj;
-    sys.trialwfn_alpha[i][j] = conj(vvec[ij]);
-   }
-  for(int i=0; i<NMO; i++)
-   for(int j=0; j<NAEA; j++, ij++) {
-    using std::conj;
-    sys.trialwfn_beta[i][j] = conj(vvec[ij]);
+    sys.trialwfn_alpha[i][j] = conj(sys.trialwfn_alpha[i][j]);
+    sys.trialwfn_beta[i][j] = conj(sys.trialwfn_beta[i][j]);
    }
 
-  // read half-rotated hamiltonian
-  // careful here!!!
-  Vakbl.setDims(Idata[2],Idata[3]);
-  Vakbl.resize(Idata[1]);
-  if(!dump.read(*(Vakbl.getVals()),"SpHijkl_vals")) return false;
-  if(!dump.read(*(Vakbl.getCols()),"SpHijkl_cols")) return false;
-  if(!dump.read(*(Vakbl.getRowIndex()),"SpHijkl_rowIndex")) return false;
-  Vakbl.setRowsFromRowIndex();
-  // morph to "compacted" notation for miniapp
-  { 
-    typename SpMat::int_iterator it = Vakbl.cols_begin();
-    typename SpMat::int_iterator itend = Vakbl.cols_end();
-    for(; it!=itend; ++it) {
-      int i = (*it)/NMO;
-      int j = (*it)%NMO;
-      int a = (i<NMO)?i:(i-NMO+NAEA);
-      if( i < NMO ) assert(i < NAEA);
-      else assert(i-NMO < NAEA);
-      *it = a*NMO+j;
+  if(!read_2body) {
+    dump.pop();
+    dump.pop();
+  } else {
+
+    // read half-rotated hamiltonian
+    // careful here!!!
+    // read directly into the final storage 
+    Vakbl.setDims(Idata[2],Idata[3]);
+    Vakbl.resize(Idata[1]);
+    if(!dump.read_strided(Vakbl.values(),"SpHijkl_vals",Idata[1])) return false;
+    if(!dump.read_strided(Vakbl.column_data(),"SpHijkl_cols",Idata[1])) return false;
+    if(!dump.read_strided(Vakbl.row_index(),"SpHijkl_rowIndex",Idata[2]+1)) return false;
+    Vakbl.setRowsFromRowIndex();
+    // morph to "compacted" notation for miniapp
+    { 
+      typename SpMat::int_iterator it = Vakbl.cols_begin();
+      typename SpMat::int_iterator itend = Vakbl.cols_end();
+      for(; it!=itend; ++it) {
+        int i = (*it)/NMO;
+        int j = (*it)%NMO;
+        int a = (i<NMO)?i:(i-NMO+NAEA);
+        if( i < NMO ) assert(i < NAEA);
+        else assert(i-NMO < NAEA);
+        *it = a*NMO+j;
+      }
+      it = Vakbl.rows_begin();    
+      itend = Vakbl.rows_end();
+      for(; it!=itend; ++it) {
+        int i = (*it)/NMO;
+        int j = (*it)%NMO;
+        int a = (i<NMO)?i:(i-NMO+NAEA);
+        if( i < NMO ) assert(i < NAEA);
+        else assert(i-NMO < NAEA);
+        *it = a*NMO+j;
+      }    
     }
-    it = Vakbl.rows_begin();    
-    itend = Vakbl.rows_end();
-    for(; it!=itend; ++it) {
-      int i = (*it)/NMO;
-      int j = (*it)%NMO;
-      int a = (i<NMO)?i:(i-NMO+NAEA);
-      if( i < NMO ) assert(i < NAEA);
-      else assert(i-NMO < NAEA);
-      *it = a*NMO+j;
-    }    
-  }
-  Vakbl.setDims(2*NMO*NAEA,2*NMO*NAEA);
-  Vakbl.compress();  // Should already be compressed, but just in case
+    Vakbl.setDims(2*NMO*NAEA,2*NMO*NAEA);
+    Vakbl.compress();  // Should already be compressed, but just in case
 
-  dump.pop();
-  dump.pop();
+    dump.pop();
+    dump.pop();
+  }
   // done reading wavefunction 
 
   // read propagator 
@@ -177,56 +270,81 @@ inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys,
   long ntot = Ldims[0];       // total number of terms
   int nrows = int(Ldims[1]);  // number of rows 
   int nvecs = int(Ldims[2]);  // number of cholesky vectors
-  int nblk = int(Ldims[4]);   // number of blocks
 
   assert(nrows == NMO*NMO);
   assert(static_cast<int>(Ldims[3]) == NMO);
 
   // read 1-body propagator
-  if(!dump.read(vvec,"Spvn_propg1")) return false;
-  if(vvec.size() != NMO*NMO) {
-    std::cerr<<" Incorrect dimensions on 1-body propagator: " <<vvec.size() <<std::endl;
+  Propg1.resize(extents[NMO][NMO]);
+  if(!dump.read_strided(Propg1.data(),"Spvn_propg1",NMO*NMO)) {
+    std::cerr<<" Incorrect dimensions on 1-body propagator. " <<std::endl;
     return false;
   }
-  Propg1.resize(extents[NMO][NMO]);
-  for(int i=0,ij=0; i<NMO; i++)       
-    for(int j=0; j<NMO; j++, ij++)
-      Propg1[i][j] = vvec[ij];
 
-  // reserve space
   Spvn.setDims(nrows,nvecs);
-  Spvn.reserve(ntot);
-
-  std::vector<int> counts(nblk);
-  if(!dump.read(counts,"Spvn_block_sizes")) return false;  
-
-  int maxsize = *std::max_element(counts.begin(), counts.end());
-  vvec.reserve(maxsize);
-  ivec.reserve(2*maxsize);
-
-  // read blocks
-  for(int i=0; i<nblk; i++) {
-   
-    // read index and data
-    vvec.resize(counts[i]);
-    ivec.resize(2*counts[i]);
-    if(!dump.read(ivec,std::string("Spvn_index_")+std::to_string(i))) return false;
-    if(!dump.read(vvec,std::string("Spvn_vals_")+std::to_string(i))) return false;
-
-    for(int n=0; n<counts[i]; n++)
-      Spvn.add(ivec[2*n],ivec[2*n+1],vvec[n]);
-    
-  }
-  Spvn.compress();
-  Spvn *= std::sqrt(dt);
 
   dump.pop();
   dump.pop();
+
+  if(read_2body) {
+
+    // a single partition is read directly into the final storage, without intermediate buffers.
+    nparts = std::max(1,nparts);
+    if(nparts == 1) return read_Spvn_partition(dump,dt,Spvn,1,0);
+
+    Spvn.resize(ntot);
+    long n = 0, nmin = ntot, nmax = 0;
+    for(int p=0; p<nparts; p++) {
+      SpMat part;
+      if(!read_Spvn_partition(dump,dt,part,nparts,p)) return false;
+      std::copy_n(part.row_data(),part.size(),Spvn.row_data(n));
+      std::copy_n(part.column_data(),part.size(),Spvn.column_data(n));
+      std::copy_n(part.values(),part.size(),Spvn.values(n));
+      n += part.size();
+      nmin = std::min(nmin,long(part.size()));
+      nmax = std::max(nmax,long(part.size()));
+    }
+    std::cout<<"  Spvn read in " <<nparts <<" partitions, terms per partition (min/max): "
+             <<nmin <<" " <<nmax <<"\n";
+    Spvn.compress();
+
+  }
   // done reading propagator
 
   return true;
 } 
 
+/**
+ * Reads the half-rotated Cholesky matrix, if present in the file (see afqmc::write_SpvnT).
+ * Returns false if it is not found, in which case it must be calculated with base::halfrotate_cholesky.
+ */
+template< class SpMat >
+inline bool read_SpvnT(hdf_archive& dump, const double dt, SpMat& SpvnT)
+{
+  if(!dump.is_group( std::string("/Propagators/phaseless_ImpSamp_ForceBias") )) return false;
+  dump.push("Propagators",false);
+  dump.push("phaseless_ImpSamp_ForceBias",false);
+  std::vector<long> Ldims(3);
+  bool ok = dump.read(Ldims,"SpvnT_dims");
+  if(ok) {
+    SpvnT.setDims(int(Ldims[1]),int(Ldims[2]));
+    SpvnT.resize(Ldims[0]);
+    ok = dump.read_strided(SpvnT.values(),"SpvnT_vals",Ldims[0]) &&
+         dump.read_strided(SpvnT.column_data(),"SpvnT_cols",Ldims[0]) &&
+         dump.read_strided(SpvnT.row_index(),"SpvnT_rowIndex",Ldims[1]+1);
+  }
+  dump.pop();
+  dump.pop();
+  if(!ok) {
+    SpvnT.clear();
+    return false;
+  }
+  SpvnT.setRowsFromRowIndex();
+  SpvnT.compress();
+  SpvnT *= std::sqrt(dt);
+  return true;
+}
+
 }  // afqmc
 
 
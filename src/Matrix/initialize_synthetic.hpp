@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file initialize_synthetic.hpp
+ *  @brief Synthetic hamiltonian, as an alternative to afqmc::Initialize for scaling studies
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_INITIALIZE_SYNTHETIC_HPP
+#define QMCPLUSPLUS_AFQMC_INITIALIZE_SYNTHETIC_HPP
+
+#include<cmath>
+#include<string>
+#include<vector>
+#include<random>
+#include<sstream>
+#include<iostream>
+#include<algorithm>
+
+#include "Configuration.h"
+#include "AFQMC/afqmc_sys.hpp"
+#include "Numerics/ma_operations.hpp"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+/**
+ * Parameters of the synthetic hamiltonian:
+ *  - NMO, NAEA (=NAEB): number of orbitals and electrons per spin
+ *  - nchol: number of Cholesky vectors
+ *  - density: fraction of non-zero elements in each Cholesky vector (sparsity of Spvn)
+ *  - cutoff: elements of Vakbl smaller than cutoff (in magnitude) are dropped
+ *  - seed: the hamiltonian is a deterministic function of the parameters
+ */
+struct synthetic_hamiltonian
+{
+  int NMO = 0;
+  int NAEA = 0;
+  int nchol = 0;
+  double density = 0.1;
+  double cutoff = 1e-6;
+  unsigned seed = 7;
+};
+
+/**
+ * Parses "NMO,NAEA,nchol[,density[,seed]]" into p.
+ */
+inline bool parse_synthetic_hamiltonian(const std::string& s, synthetic_hamiltonian& p)
+{
+  std::vector<double> v;
+  std::stringstream ss(s);
+  std::string item;
+  while(std::getline(ss,item,','))
+    v.push_back(atof(item.c_str()));
+  if(v.size() < 3 || v.size() > 5) return false;
+  p.NMO = int(v[0]);
+  p.NAEA = int(v[1]);
+  p.nchol = int(v[2]);
+  if(v.size() > 3) p.density = v[3];
+  if(v.size() > 4) p.seed = unsigned(v[4]);
+  return p.NMO > 0 && p.NAEA > 0 && p.NAEA <= p.NMO && p.nchol > 0 &&
+         p.density > 0.0 && p.density <= 1.0;
+}
+
+/**
+ * Builds a random hamiltonian with the structure of a molecule in a basis of localized orbitals,
+ * in the same form as afqmc::Initialize produces from an afqmc.h5 file:
+ *  - Cholesky vectors L_n are real symmetric matrices supported on a window of w=sqrt(density)*NMO
+ *    consecutive orbitals centered at a random orbital, with elements decaying away from the
+ *    diagonal and norms decaying with n, normalized so that (ii|ii) ~ 0.5.
+ *    Spvn(ik,n) = sqrt(dt) * L_n(i,k).
+ *  - the trial wave function occupies the lowest NAEA orbitals of both spins.
+ *  - h(i,j): increasing orbital energies on the diagonal and a short range hopping.
+ *    haj holds the occupied rows, Propg1 = exp(-0.5*dt*h).
+ *  - Vakbl(ak,bl) = (ak|bl) - (al|bk) for equal spins and (ak|bl) for opposite spins,
+ *    with (ik|jl) = sum_n L_n(i,k) L_n(j,l), in the compact notation used by the miniapp.
+ */
+template< class SpMat,
+          class Mat
+        >
+inline bool Initialize_synthetic(const synthetic_hamiltonian& p, const double dt, base::afqmc_sys& sys,
+                                 Mat& Propg1, SpMat& Spvn, Mat& haj, SpMat& Vakbl)
+{
+  typedef typename SpMat::value_type Type;
+  const int NMO = p.NMO;
+  const int NAEA = p.NAEA;
+  const int nchol = p.nchol;
+
+  std::cout<<"  Synthetic hamiltonian: NMO=" <<NMO <<" NAEA=" <<NAEA <<" nchol=" <<nchol
+           <<" density=" <<p.density <<" seed=" <<p.seed <<"\n";
+
+  std::mt19937 gen(p.seed);
+  std::normal_distribution<double> normal(0.0,1.0);
+  std::uniform_real_distribution<double> uniform(-1.0,1.0);
+
+  sys.setup(NMO,NAEA);
+
+  // trial wave function (stored conjugated, as in Initialize)
+  sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
+  sys.trialwfn_beta.resize(extents[NMO][NAEA]);
+  std::fill_n(sys.trialwfn_alpha.data(),NMO*NAEA,Type(0));
+  std::fill_n(sys.trialwfn_beta.data(),NMO*NAEA,Type(0));
+  for(int a=0; a<NAEA; a++)
+    sys.trialwfn_alpha[a][a] = sys.trialwfn_beta[a][a] = Type(1);
+
+  // 1-body hamiltonian
+  boost::multi_array<Type,2> h(extents[NMO][NMO]);
+  std::fill_n(h.data(),h.num_elements(),Type(0));
+  for(int i=0; i<NMO; i++) {
+    h[i][i] = Type(-2.0 + 3.0*i/std::max(1,NMO-1));
+    for(int j=i+1; j<std::min(NMO,i+3); j++)
+      h[i][j] = h[j][i] = Type(0.05*uniform(gen)/(j-i));
+  }
+  haj.resize(extents[2*NAEA][NMO]);
+  for(int a=0; a<NAEA; a++)
+    for(int j=0; j<NMO; j++)
+      haj[a][j] = haj[a+NAEA][j] = h[a][j];
+
+  // Propg1 = exp(-0.5*dt*h), Taylor series
+  {
+    Propg1.resize(extents[NMO][NMO]);
+    boost::multi_array<Type,2> T1(extents[NMO][NMO]), T2(extents[NMO][NMO]);
+    std::fill_n(Propg1.data(),NMO*NMO,Type(0));
+    std::fill_n(T1.data(),NMO*NMO,Type(0));
+    for(int i=0; i<NMO; i++) Propg1[i][i] = T1[i][i] = Type(1);
+    for(int n=1; n<=12; n++) {
+      ma::product(Type(-0.5*dt/n),h,T1,Type(0),T2);
+      std::swap(T1,T2);
+      for(int i=0; i<NMO; i++)
+        for(int j=0; j<NMO; j++)
+          Propg1[i][j] += T1[i][j];
+    }
+  }
+
+  // Cholesky vectors, Lh holds the occupied rows, Lh(a*NMO+k,n) = L_n(a,k)
+  int w = std::max(1,std::min(NMO,int(std::lround(std::sqrt(p.density)*NMO))));
+  double norm = 0.0;
+  for(int n=0; n<nchol; n++) norm += std::exp(-2.0*n/nchol);
+  double scale = std::sqrt(0.5*NMO/(double(w)*norm));
+  boost::multi_array<Type,2> Lh(extents[NAEA*NMO][nchol]);
+  std::fill_n(Lh.data(),Lh.num_elements(),Type(0));
+  Spvn.setDims(NMO*NMO,nchol);
+  Spvn.reserve(static_cast<unsigned long>(w)*w*nchol);
+  std::uniform_int_distribution<int> center(0,NMO-w);
+  for(int n=0; n<nchol; n++) {
+    int i0 = center(gen);
+    double an = scale*std::exp(-double(n)/nchol);
+    for(int i=i0; i<i0+w; i++)
+      for(int k=i; k<i0+w; k++) {
+        Type v = Type(an*normal(gen)*std::exp(-0.5*(k-i)));
+        Spvn.add(i*NMO+k,n,v);
+        if(k != i) Spvn.add(k*NMO+i,n,v);
+        if(i < NAEA) Lh[i*NMO+k][n] = v;
+        if(k < NAEA) Lh[k*NMO+i][n] = v;
+      }
+  }
+  Spvn.compress();
+  Spvn *= std::sqrt(dt);
+
+  // Vakbl, from blocks D_a(k,bl) = (ak|bl) = sum_n Lh(ak,n) Lh(bl,n)
+  int NAK = 2*NAEA*NMO;
+  Vakbl.setDims(NAK,NAK);
+  boost::multi_array<Type,2> Da(extents[NMO][NAEA*NMO]);
+  using ma::T;
+  for(int a=0; a<NAEA; a++) {
+    boost::multi_array_ref<Type,2> La(Lh.data()+long(a)*NMO*nchol,extents[NMO][nchol]);
+    ma::product(La,T(Lh),Da);
+    for(int k=0; k<NMO; k++)
+      for(int b=0; b<NAEA; b++)
+        for(int l=0; l<NMO; l++) {
+          Type direct = Da[k][b*NMO+l];
+          Type same = direct - Da[l][b*NMO+k];
+          int ak = a*NMO+k, bl = b*NMO+l;
+          int AK = ak+NAEA*NMO, BL = bl+NAEA*NMO;
+          if(std::abs(same) > p.cutoff) {
+            Vakbl.add(ak,bl,same);
+            Vakbl.add(AK,BL,same);
+          }
+          if(std::abs(direct) > p.cutoff) {
+            Vakbl.add(ak,BL,direct);
+            Vakbl.add(AK,bl,direct);
+          }
+        }
+  }
+  Vakbl.compress();
+
+  return true;
+}
+
+}  // afqmc
+
+} // qmcplusplus
+
+#endif
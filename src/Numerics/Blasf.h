@@ -98,6 +98,14 @@
 #define sorglq sorglq_
 #define zunglq zunglq_
 #define cunglq cunglq_
+#define dpotrf dpotrf_
+#define spotrf spotrf_
+#define zpotrf zpotrf_
+#define cpotrf cpotrf_
+#define dtrsm dtrsm_
+#define strsm strsm_
+#define ztrsm ztrsm_
+#define ctrsm ctrsm_
 
 #if defined(HAVE_MKL)
 #define dzgemv dzgemv_
@@ -338,6 +346,33 @@ void zhegvx(int &, char &JOBZ, char &RANGE, char &UPLO, int &N,
   void sorglq( const int &M, const int &N, const int &K, float *A, const int &LDA, float *TAU, float *WORK, const int &LWORK, int &INFO );
 
 
+  void zpotrf( const char &UPLO, const int &N, std::complex<double> *A, const int &LDA, int &INFO );
+
+  void cpotrf( const char &UPLO, const int &N, std::complex<float> *A, const int &LDA, int &INFO );
+
+  void dpotrf( const char &UPLO, const int &N, double *A, const int &LDA, int &INFO );
+
+  void spotrf( const char &UPLO, const int &N, float *A, const int &LDA, int &INFO );
+
+void ztrsm(const char &SIDE, const char &UPLO, const char &TRANSA, const char &DIAG,
+           const int &M, const int &N, const std::complex<double> &ALPHA,
+           const std::complex<double> *A, const int &LDA, std::complex<double> *B,
+           const int &LDB);
+
+void ctrsm(const char &SIDE, const char &UPLO, const char &TRANSA, const char &DIAG,
+           const int &M, const int &N, const std::complex<float> &ALPHA,
+           const std::complex<float> *A, const int &LDA, std::complex<float> *B,
+           const int &LDB);
+
+void dtrsm(const char &SIDE, const char &UPLO, const char &TRANSA, const char &DIAG,
+           const int &M, const int &N, const double &ALPHA, const double *A,
+           const int &LDA, double *B, const int &LDB);
+
+void strsm(const char &SIDE, const char &UPLO, const char &TRANSA, const char &DIAG,
+           const int &M, const int &N, const float &ALPHA, const float *A,
+           const int &LDA, float *B, const int &LDB);
+
+
 void dger(const int *m, const int *n, const double *alpha, const double *x,
           const int *incx, const double *y, const int *incy, double *a,
           const int *lda);
@@ -396,6 +396,36 @@ struct BLAS
   {
     cgeru(&m, &n, &alpha, x, &incx, y, &incy, a, &lda);
   }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int m,
+                          int n, double alpha, const double *a, int lda,
+                          double *b, int ldb)
+  {
+    dtrsm(side, uplo, transa, diag, m, n, alpha, a, lda, b, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int m,
+                          int n, float alpha, const float *a, int lda, float *b,
+                          int ldb)
+  {
+    strsm(side, uplo, transa, diag, m, n, alpha, a, lda, b, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int m,
+                          int n, std::complex<double> alpha,
+                          const std::complex<double> *a, int lda,
+                          std::complex<double> *b, int ldb)
+  {
+    ztrsm(side, uplo, transa, diag, m, n, alpha, a, lda, b, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int m,
+                          int n, std::complex<float> alpha,
+                          const std::complex<float> *a, int lda,
+                          std::complex<float> *b, int ldb)
+  {
+    ctrsm(side, uplo, transa, diag, m, n, alpha, a, lda, b, ldb);
+  }
 };
 
 struct LAPACK
@@ -574,6 +604,26 @@ struct LAPACK
 	sorglq(M,N,K,A,LDA,TAU,WORK,LWORK,INFO);
   }
 
+  void static potrf(char UPLO, int N, std::complex<double> *A, const int LDA, int& INFO)
+  {
+	zpotrf(UPLO,N,A,LDA,INFO);
+  }
+
+  void static potrf(char UPLO, int N, double *A, const int LDA, int& INFO)
+  {
+	dpotrf(UPLO,N,A,LDA,INFO);
+  }
+
+  void static potrf(char UPLO, int N, std::complex<float> *A, const int LDA, int& INFO)
+  {
+	cpotrf(UPLO,N,A,LDA,INFO);
+  }
+
+  void static potrf(char UPLO, int N, float *A, const int LDA, int& INFO)
+  {
+	spotrf(UPLO,N,A,LDA,INFO);
+  }
+
 };
 
 #endif // OHMMS_BLAS_H
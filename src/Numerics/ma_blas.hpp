@@ -59,7 +59,7 @@ MultiArray1DY gemv(T alpha, MultiArray2DA const& A, MultiArray1DX const& x, T be
 	assert( A.strides()[1] == 1 ); // gemv is not implemented for arrays with non-leading stride != 1
 	int M = A.shape()[1];
 	int N = A.shape()[0];
-	BLAS::gemv(IN, M, N, alpha, A.origin(), A.strides()[0], x.origin(), x.strides()[0], beta, y.origin(), y.strides()[0]);
+	BLAS::gemv(IN == 'H' ? 'C' : IN, M, N, alpha, A.origin(), A.strides()[0], x.origin(), x.strides()[0], beta, y.origin(), y.strides()[0]);
 	return std::forward<MultiArray1DY>(y);
 } //y := alpha*A*x + beta*y,
 
@@ -109,8 +109,9 @@ MultiArray2DC gemm(T alpha, MultiArray2DA const& a, MultiArray2DB const& b, T be
 		K = a.shape()[0];
 		assert(a.shape()[0] == b.shape()[0] and c.shape()[0] == b.shape()[1] and c.shape()[1] == a.shape()[1]);
 	}
+	// BLAS expects 'C' for the conjugate transpose
 	BLAS::gemm(
-		TA, TB, 
+		TA == 'H' ? 'C' : TA, TB == 'H' ? 'C' : TB, 
 		M, N, K, alpha, 
 		a.origin(), a.strides()[0], 
 		b.origin(), b.strides()[0],
@@ -125,6 +126,30 @@ MultiArray2DC gemm(MultiArray2DA const& a, MultiArray2DB const& b, MultiArray2DC
 	return gemm(1., a, b, 0., std::forward<MultiArray2DC>(c));
 }
 
+// B = alpha * op(A)^(-1) * B (SIDE == 'L') or B = alpha * B * op(A)^(-1) (SIDE == 'R'),
+// with A triangular (UPLO = 'U' or 'L') and all matrices in row-major order.
+// The row-major problem is the transposed column-major one, so SIDE and UPLO are swapped.
+template<char SIDE, char UPLO, char TA, char DIAG, class T, class MultiArray2DA, class MultiArray2DB,
+	typename = typename std::enable_if< MultiArray2DA::dimensionality == 2 and std::decay<MultiArray2DB>::type::dimensionality == 2>::type
+>
+MultiArray2DB trsm(T alpha, MultiArray2DA const& a, MultiArray2DB&& b){
+	assert( a.strides()[1] == 1 );
+	assert( b.strides()[1] == 1 );
+	assert( a.shape()[0] == a.shape()[1] );
+	assert( (SIDE == 'L') || (SIDE == 'R') );
+	assert( (UPLO == 'U') || (UPLO == 'L') );
+	assert( (TA == 'N') || (TA == 'T') || (TA == 'H') );
+	if(SIDE == 'L') assert( a.shape()[0] == b.shape()[0] );
+	else assert( a.shape()[0] == b.shape()[1] );
+	BLAS::trsm(
+		SIDE == 'L' ? 'R' : 'L', UPLO == 'U' ? 'L' : 'U', TA == 'H' ? 'C' : TA, DIAG, 
+		b.shape()[1], b.shape()[0], alpha, 
+		a.origin(), a.strides()[0], 
+		b.origin(), b.strides()[0]
+	);
+	return std::forward<MultiArray2DB>(b);
+}
+
 }
 
 #ifdef _TEST_MA_BLAS
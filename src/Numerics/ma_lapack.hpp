@@ -27,8 +27,8 @@
 
 namespace ma{
 
-double const& real(double const& d){return d;}
-float const& real(float const& f){return f;}
+inline double const& real(double const& d){return d;}
+inline float const& real(float const& f){return f;}
 
 template<class MultiArray2D, class Array1D>
 MultiArray2D getrf(MultiArray2D&& m, Array1D& pivot){
@@ -220,6 +220,24 @@ MultiArray2D glq(MultiArray2D&& A, Array1D&& TAU, Buffer&& WORK){
 	return std::forward<MultiArray2D>(A);
 }
 
+// Cholesky factorization of the hermitian positive definite matrix A = H(U)*U (row-major),
+// U is returned in the upper triangle of A, the strict lower triangle is not referenced.
+// Returns the status of LAPACK::potrf, status > 0 if A is not positive definite.
+template<class MultiArray2D>
+int potrf(MultiArray2D&& A){
+	assert(A.strides()[1] == 1);
+	assert(A.shape()[0] == A.shape()[1]);
+
+	int status = -1;
+	// the row-major upper triangle is the column-major lower triangle of conj(A)
+	LAPACK::potrf(
+		'L', A.shape()[0], A.origin(), A.strides()[0], 
+		status
+	);
+	assert(status>=0);
+	return status;
+}
+
 }
 
 #ifdef _TEST_MA_LAPACK
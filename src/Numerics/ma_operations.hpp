@@ -30,8 +30,8 @@
 
 namespace ma{
 
-double const& conj(double const& d){return d;}
-float const& conj(float const& f){return f;}
+inline double const& conj(double const& d){return d;}
+inline float const& conj(float const& f){return f;}
 
 template<class MultiArray2D, typename = typename std::enable_if<(MultiArray2D::dimensionality > 1)>::type>
 bool is_hermitian(MultiArray2D const& A){
@@ -143,9 +143,64 @@ MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T
         return std::forward<MultiArray2DC>(C);
 }
 
+// SELL-C-sigma matrix-MultiArray interface
+template<class T, class SparseMatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                SparseMatrixA::dimensionality == -3 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch
+        typename = void, // TODO change to use dispatch
+        typename = void // TODO change to use dispatch
+>
+MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        using Type = typename std::decay<decltype(arg(A))>::type::value_type;
+        assert(op_tag<MultiArray2DB>::value == 'N');
+        assert( arg(B).strides()[1] == 1 );
+        assert( std::forward<MultiArray2DC>(C).strides()[1] == 1 );
+        if(op_tag<SparseMatrixA>::value == 'N') {
+            assert(arg(A).rows() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(A).cols() == arg(B).shape()[0]);
+        } else {
+            assert(arg(A).rows() == arg(B).shape()[0]);
+            assert(arg(A).cols() == std::forward<MultiArray2DC>(C).shape()[0]);
+        }
+        assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+
+        SPBLAS::sellmm( op_tag<SparseMatrixA>::value,
+            arg(A).rows(), arg(B).shape()[1], arg(A).cols(),
+            static_cast<Type>(alpha), arg(A).chunk_size(), arg(A).num_chunks(),
+            arg(A).val(), arg(A).indx(), arg(A).chunk_ptr(), arg(A).chunk_len(), arg(A).row_len(), arg(A).row_perm(),
+            arg(B).origin(), arg(B).strides()[0],
+            static_cast<Type>(beta),
+            std::forward<MultiArray2DC>(C).origin(), std::forward<MultiArray2DC>(C).strides()[0]);
+
+        return std::forward<MultiArray2DC>(C);
+}
+
+// runtime selectable storage (see Matrix/MatrixOperator.hpp), dispatches to one of the overloads above
+template<class T, class MatrixOperatorA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                MatrixOperatorA::dimensionality == -4 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch
+        typename = void, // TODO change to use dispatch
+        typename = void, // TODO change to use dispatch
+        typename = void // TODO change to use dispatch
+>
+MultiArray2DC product(T alpha, MatrixOperatorA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        assert(op_tag<MultiArray2DB>::value == 'N');
+        arg(A).product(op_tag<MatrixOperatorA>::value, alpha, arg(B), beta, std::forward<MultiArray2DC>(C));
+        return std::forward<MultiArray2DC>(C);
+}
+
 template<class MultiArray2DA, class MultiArray2DB, class MultiArray2DC,
         typename = typename std::enable_if<
-                (MultiArray2DA::dimensionality == 2 or MultiArray2DA::dimensionality == -2) and
+                (MultiArray2DA::dimensionality == 2 or MultiArray2DA::dimensionality == -2 or
+                 MultiArray2DA::dimensionality == -3 or MultiArray2DA::dimensionality == -4) and
                 MultiArray2DB::dimensionality == 2 and
                 std::decay<MultiArray2DC>::type::dimensionality == 2
         >::type
@@ -21,6 +21,7 @@
 #include "Numerics/spblas.hpp"
 #include<cassert>
 #include<complex>
+#include<algorithm>
 
 struct mySPBLAS
 {
@@ -215,6 +216,224 @@ struct mySPBLAS
     }
   }
 
+  /**
+   * C = alpha*op(A)*B + beta*C, with A (MxK) in SELL-C-sigma format (see Matrix/SELLMatrix.hpp).
+   * chunk: rows per chunk, nchunks: number of chunks, cptr/clen: offset and length of each chunk,
+   * rlen: length of each stored row (0 for padding), perm: original row of each stored row (-1 for padding).
+   * B and C are row-major.
+   */
+  template<typename T>
+  inline static
+  void sellmm(const char transa, const int M, const int N, const int K, const T alpha, const int chunk, const int nchunks, const T *A, const int *indx, const int *cptr, const int *clen, const int *rlen, const int *perm, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  {
+    if(transa=='n' || transa=='N') {
+      for(int i=0; i<M; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      // slices of sell_lanes rows of a chunk and sell_cols columns of C are accumulated in acc,
+      // the innermost loop runs over the rows of the slice, contiguous in A and indx
+      const int L = sell_lanes, NB = sell_cols;
+      for(int k=0; k<nchunks; k++, perm+=chunk, rlen+=chunk) {
+        for(int r0=0; r0<chunk && rlen[r0]>0; r0+=L) {
+          int nl = std::min(L,chunk-r0);
+          for(int i0=0; i0<N; i0+=NB) {
+            int nb = std::min(NB,N-i0);
+            T acc[NB][L];
+            for(int i=0; i<nb; i++)
+              std::fill_n(acc[i],nl,T(0));
+            const T* Ak = A + cptr[k] + r0;
+            const int* Ik = indx + cptr[k] + r0;
+            // rows are sorted by decreasing length, nr rows of the slice are longer than j
+            for(int j=0, nr=nl; j<rlen[r0]; j++, Ak+=chunk, Ik+=chunk) {
+              while(rlen[r0+nr-1] <= j) nr--;
+              // offsets of B(c,i0) for the rows of the slice
+              int ob[L];
+              for(int r=0; r<nr; r++)
+                ob[r] = ldb*Ik[r]+i0;
+              for(int i=0; i<nb; i++) {
+                const T* Bi = B+i;
+                T* ai = acc[i];
+                #pragma omp simd
+                for(int r=0; r<nr; r++)
+                  ai[r] += Ak[r] * Bi[ob[r]];
+              }
+            }
+            for(int r=0; r<nl && rlen[r0+r]>0; r++) {
+              T* Cr = C+ldc*perm[r0+r]+i0;
+              for(int i=0; i<nb; i++)
+                Cr[i] += alpha * acc[i][r];
+            }
+          }
+        }
+      }
+    } else if(transa=='t' || transa=='T' || transa=='h' || transa=='H') {
+      bool herm = (transa=='h' || transa=='H');
+      for(int i=0; i<K; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      // rows of a chunk can share a column, so C(c,:) is updated one element at a time
+      for(int k=0; k<nchunks; k++, perm+=chunk, rlen+=chunk) {
+        const T* Ak = A + cptr[k];
+        const int* Ik = indx + cptr[k];
+        for(int j=0; j<clen[k]; j++, Ak+=chunk, Ik+=chunk) {
+          for(int r=0; r<chunk && rlen[r]>j; r++) {
+            // C(c,:) += A_rc * B(perm[r],:)
+            const T* Br = B+ldb*perm[r];
+            T* Cc = C+ldc*Ik[r];
+            T Arc = alpha*(herm?conjugate(Ak[r]):Ak[r]);
+            for(int i=0; i<N; i++)
+              Cc[i] += Arc * Br[i];
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Planar complex versions of csrmm and sellmm, see Matrix/PlanarMatrix.hpp:
+   * B and C are given by their real (Br,Cr) and imaginary (Bi,Ci) parts, row-major with
+   * leading dimensions ldb and ldc. A has complex values and zero-based indexes.
+   * The multiply-add works on separate real arrays, so it vectorizes without shuffles.
+   */
+  template<typename T>
+  inline static
+  void csrmm_planar(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const std::complex<T> *A, const int *indx, const int *pntrb, const int *pntre, const T *Br, const T *Bi, const int ldb, const std::complex<T> beta, T *Cr, T *Ci, const int ldc)
+  {
+    int p0 = *pntrb;
+    if(transa=='n' || transa=='N') {
+      for(int nr=0; nr<M; nr++,pntrb++,pntre++,Cr+=ldc,Ci+=ldc) {
+        scale_planar(N,beta,Cr,Ci);
+        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+          if(indx[i] >= K) continue;
+          // C(r,:) += A_rc * B(c,:)
+          std::complex<T> Arc = alpha*A[i];
+          axpy_planar(N,Arc,Br+ldb*indx[i],Bi+ldb*indx[i],Cr,Ci);
+        }
+      }
+    } else if(transa=='t' || transa=='T' || transa=='h' || transa=='H') {
+      bool herm = (transa=='h' || transa=='H');
+      for(int i=0; i<K; i++)
+        scale_planar(N,beta,Cr+i*ldc,Ci+i*ldc);
+      for(int nr=0; nr<M; nr++,pntrb++,pntre++,Br+=ldb,Bi+=ldb) {
+        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+          if(indx[i] >= K) continue;
+          // C(c,:) += A_rc * B(r,:)
+          std::complex<T> Arc = alpha*(herm?std::conj(A[i]):A[i]);
+          axpy_planar(N,Arc,Br,Bi,Cr+ldc*indx[i],Ci+ldc*indx[i]);
+        }
+      }
+    }
+  }
+
+  template<typename T>
+  inline static
+  void sellmm_planar(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const int chunk, const int nchunks, const std::complex<T> *A, const int *indx, const int *cptr, const int *clen, const int *rlen, const int *perm, const T *Br, const T *Bi, const int ldb, const std::complex<T> beta, T *Cr, T *Ci, const int ldc)
+  {
+    bool trans = !(transa=='n' || transa=='N');
+    bool herm = (transa=='h' || transa=='H');
+    for(int i=0, ie=(trans?K:M); i<ie; i++)
+      scale_planar(N,beta,Cr+i*ldc,Ci+i*ldc);
+    if(!trans) {
+      // same slicing as sellmm
+      const int L = sell_lanes, NB = sell_cols;
+      const T alpha_r = alpha.real(), alpha_i = alpha.imag();
+      for(int k=0; k<nchunks; k++, perm+=chunk, rlen+=chunk) {
+        for(int r0=0; r0<chunk && rlen[r0]>0; r0+=L) {
+          int nl = std::min(L,chunk-r0);
+          for(int i0=0; i0<N; i0+=NB) {
+            int nb = std::min(NB,N-i0);
+            T accr[NB][L], acci[NB][L];
+            for(int i=0; i<nb; i++) {
+              std::fill_n(accr[i],nl,T(0));
+              std::fill_n(acci[i],nl,T(0));
+            }
+            const std::complex<T>* Ak = A + cptr[k] + r0;
+            const int* Ik = indx + cptr[k] + r0;
+            for(int j=0, nr=nl; j<rlen[r0]; j++, Ak+=chunk, Ik+=chunk) {
+              while(rlen[r0+nr-1] <= j) nr--;
+              int ob[L];
+              for(int r=0; r<nr; r++)
+                ob[r] = ldb*Ik[r]+i0;
+              for(int i=0; i<nb; i++) {
+                const T* bri = Br+i;
+                const T* bii = Bi+i;
+                T* ar = accr[i];
+                T* ai = acci[i];
+                #pragma omp simd
+                for(int r=0; r<nr; r++) {
+                  const T a_r = Ak[r].real(), a_i = Ak[r].imag();
+                  const T b_r = bri[ob[r]], b_i = bii[ob[r]];
+                  ar[r] += a_r*b_r - a_i*b_i;
+                  ai[r] += a_r*b_i + a_i*b_r;
+                }
+              }
+            }
+            for(int r=0; r<nl && rlen[r0+r]>0; r++) {
+              T* cr = Cr+ldc*perm[r0+r]+i0;
+              T* ci = Ci+ldc*perm[r0+r]+i0;
+              for(int i=0; i<nb; i++) {
+                cr[i] += alpha_r*accr[i][r] - alpha_i*acci[i][r];
+                ci[i] += alpha_r*acci[i][r] + alpha_i*accr[i][r];
+              }
+            }
+          }
+        }
+      }
+      return;
+    }
+    for(int k=0; k<nchunks; k++, perm+=chunk, rlen+=chunk) {
+      const std::complex<T>* Ak = A + cptr[k];
+      const int* Ik = indx + cptr[k];
+      for(int j=0; j<clen[k]; j++, Ak+=chunk, Ik+=chunk) {
+        for(int r=0; r<chunk && rlen[r]>j; r++) {
+          std::complex<T> Arc = alpha*(herm?std::conj(Ak[r]):Ak[r]);
+          axpy_planar(N,Arc,Br+ldb*perm[r],Bi+ldb*perm[r],Cr+ldc*Ik[r],Ci+ldc*Ik[r]);
+        }
+      }
+    }
+  }
+
+  private:
+
+  // rows and columns of C per slice in the non-transposed SELL products, see sellmm
+  enum { sell_lanes = 16, sell_cols = 4 };
+
+  // (cr,ci) += a*(br,bi)
+  template<typename T>
+  inline static void axpy_planar(const int N, const std::complex<T> a, const T* br, const T* bi, T* cr, T* ci)
+  {
+    const T ar = a.real(), ai = a.imag();
+    #pragma omp simd
+    for(int k=0; k<N; k++) {
+      cr[k] += ar*br[k] - ai*bi[k];
+      ci[k] += ar*bi[k] + ai*br[k];
+    }
+  }
+
+  // (cr,ci) *= b, C is set to zero if b==0
+  template<typename T>
+  inline static void scale_planar(const int N, const std::complex<T> b, T* cr, T* ci)
+  {
+    if(b == std::complex<T>(0)) {
+      std::fill_n(cr,N,T(0));
+      std::fill_n(ci,N,T(0));
+    } else if(b != std::complex<T>(1)) {
+      const T b_r = b.real(), b_i = b.imag();
+      #pragma omp simd
+      for(int k=0; k<N; k++) {
+        T r = cr[k];
+        cr[k] = b_r*r - b_i*ci[k];
+        ci[k] = b_r*ci[k] + b_i*r;
+      }
+    }
+  }
+
+  template<typename T>
+  inline static T conjugate(const T a) { return a; }
+
+  template<typename T>
+  inline static std::complex<T> conjugate(const std::complex<T> a) { return std::conj(a); }
+
 };
 
 #if defined(HAVE_MKL)
@@ -307,6 +526,29 @@ struct SPBLAS
 #endif
   }
 
+  // no vendor implementation of SELL-C-sigma, always use mySPBLAS
+  template<typename T>
+  inline static
+  void sellmm(const char transa, const int M, const int N, const int K, const T alpha, const int chunk, const int nchunks, const T *A, const int *indx, const int *cptr, const int *clen, const int *rlen, const int *perm, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  {
+    mySPBLAS::sellmm(transa,M,N,K,alpha,chunk,nchunks,A,indx,cptr,clen,rlen,perm,B,ldb,beta,C,ldc);
+  }
+
+  // planar complex B and C, always use mySPBLAS
+  template<typename T>
+  inline static
+  void csrmm_planar(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const std::complex<T> *A, const int *indx, const int *pntrb, const int *pntre, const T *Br, const T *Bi, const int ldb, const std::complex<T> beta, T *Cr, T *Ci, const int ldc)
+  {
+    mySPBLAS::csrmm_planar(transa,M,N,K,alpha,A,indx,pntrb,pntre,Br,Bi,ldb,beta,Cr,Ci,ldc);
+  }
+
+  template<typename T>
+  inline static
+  void sellmm_planar(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const int chunk, const int nchunks, const std::complex<T> *A, const int *indx, const int *cptr, const int *clen, const int *rlen, const int *perm, const T *Br, const T *Bi, const int ldb, const std::complex<T> beta, T *Cr, T *Ci, const int ldc)
+  {
+    mySPBLAS::sellmm_planar(transa,M,N,K,alpha,chunk,nchunks,A,indx,cptr,clen,rlen,perm,Br,Bi,ldb,beta,Cr,Ci,ldc);
+  }
+
 };
 
 
@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Random matrices and reference results shared by the unit tests of the miniapp kernels.
+
+#ifndef QMCPLUSPLUS_AFQMC_KERNEL_TEST_HELPERS_H
+#define QMCPLUSPLUS_AFQMC_KERNEL_TEST_HELPERS_H
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "Matrix/MatrixOperator.hpp"
+
+#include <random>
+#include <complex>
+
+namespace qmcplusplus
+{
+
+typedef boost::multi_array<ComplexType,2> CMatrix;
+
+template<class Mat>
+void fill_random(Mat& A, std::mt19937& gen, RealType scale=1.0)
+{
+  std::uniform_real_distribution<RealType> dist(-scale,scale);
+  for(ComplexType *p=A.data(), *pe=A.data()+A.num_elements(); p!=pe; ++p)
+    *p = ComplexType(dist(gen),dist(gen));
+}
+
+// random nr x nc matrix with the given density, in A.csr() and in the dense matrix D
+inline void random_operator(MatrixOperator<ComplexType>& A, CMatrix& D, int nr, int nc, double density, std::mt19937& gen)
+{
+  std::uniform_real_distribution<RealType> dist(-1.0,1.0);
+  std::uniform_real_distribution<double> u(0.0,1.0);
+  D.resize(extents[nr][nc]);
+  std::fill_n(D.data(),D.num_elements(),ComplexType(0));
+  A.csr().setDims(nr,nc);
+  for(int i=0; i<nr; i++)
+    for(int j=0; j<nc; j++)
+      if(u(gen) < density) {
+        D[i][j] = ComplexType(dist(gen),dist(gen));
+        A.csr().add(i,j,D[i][j]);
+      }
+  A.csr().compress();
+}
+
+// C = op(D) * B
+inline CMatrix reference_product(char op, const CMatrix& D, const CMatrix& B)
+{
+  int nr = D.shape()[0], nc = D.shape()[1], n = B.shape()[1];
+  CMatrix C(extents[(op=='N')?nr:nc][n]);
+  std::fill_n(C.data(),C.num_elements(),ComplexType(0));
+  for(int i=0; i<nr; i++)
+    for(int j=0; j<nc; j++)
+      for(int k=0; k<n; k++) {
+        if(op == 'N') C[i][k] += D[i][j]*B[j][k];
+        else C[j][k] += D[i][j]*B[i][k];
+      }
+  return C;
+}
+
+template<class MatA, class MatB>
+void check_equal(const MatA& A, const MatB& B, double eps=1e-10)
+{
+  REQUIRE(A.num_elements() == B.num_elements());
+  for(std::size_t i=0; i<A.num_elements(); i++) {
+    REQUIRE(A.data()[i].real() == Approx(B.data()[i].real()).margin(eps));
+    REQUIRE(A.data()[i].imag() == Approx(B.data()[i].imag()).margin(eps));
+  }
+}
+
+}
+
+#endif
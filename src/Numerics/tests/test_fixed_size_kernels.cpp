@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the kernels specialized for a fixed number of electrons against the generic kernels.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "AFQMC/afqmc_sys.hpp"
+#include "AFQMC/vHS.hpp"
+#include "Numerics/tests/kernel_test_helpers.h"
+
+namespace qmcplusplus
+{
+
+TEST_CASE("fixed_size_kernels", "[afqmc_kernels]")
+{
+  const int NMO = 12, NAEA = 4, nwalk = 3;
+  std::mt19937 gen(29);
+  base::afqmc_sys sys(NMO,NAEA);
+  sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
+  sys.trialwfn_beta.resize(extents[NMO][NAEA]);
+  fill_random(sys.trialwfn_alpha,gen);
+  fill_random(sys.trialwfn_beta,gen);
+  WalkerContainer W(extents[nwalk][2][NMO][NAEA]);
+  fill_random(W,gen);
+
+  REQUIRE(sys.use_fixed_size_kernels(true));
+  for(bool compact: {true, false}) {
+    int N_ = compact?NAEA:NMO;
+    CMatrix G0(extents[2*N_*NMO][nwalk]), G1(extents[2*N_*NMO][nwalk]);
+    CMatrix Wd0(extents[nwalk][8]), Wd1(extents[nwalk][8]);
+    sys.use_fixed_size_kernels(false);
+    sys.calculate_mixed_density_matrix(W,Wd0,G0,compact);
+    sys.use_fixed_size_kernels(true);
+    sys.calculate_mixed_density_matrix(W,Wd1,G1,compact);
+    check_equal(G1,G0);
+    check_equal(Wd1,Wd0);
+  }
+
+  CMatrix Wd0(extents[nwalk][8]), Wd1(extents[nwalk][8]);
+  sys.use_fixed_size_kernels(false);
+  sys.calculate_overlaps(W,Wd0);
+  sys.use_fixed_size_kernels(true);
+  sys.calculate_overlaps(W,Wd1);
+  check_equal(Wd1,Wd0);
+
+  auto k = base::get_fixed_size_kernels<ComplexType>(NMO,NAEA);
+  REQUIRE(k != nullptr);
+  CMatrix V(extents[NMO][NMO]), S0(extents[NMO][NAEA]);
+  fill_random(V,gen,0.1);
+  fill_random(S0,gen);
+  CMatrix S1(S0), T1(extents[NMO][NAEA]), T2(extents[NMO][NAEA]);
+  base::apply_expM(V,S0,T1,T2,6);
+  k->expM(NMO,V.origin(),S1.origin(),T1.origin(),T2.origin(),6);
+  check_equal(S1,S0);
+}
+
+}
@@ -0,0 +1,48 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the per-walker random number streams of the auxiliary fields.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "AFQMC/force_bias.hpp"
+#include "Utilities/RandomGenerator.h"
+#include "Numerics/tests/kernel_test_helpers.h"
+
+namespace qmcplusplus
+{
+
+TEST_CASE("auxiliary_field_streams", "[afqmc_kernels]")
+{
+  typedef PhiloxRandom<RealType> RNG;
+  // the auxiliary fields of a walker do not depend on how walkers are split in batches
+  const int nchol = 11, nwalk = 21, nb = 8;
+  std::mt19937 gen(19);
+  CMatrix vbias(extents[nchol][nwalk]), X(extents[nchol][nwalk]);
+  fill_random(vbias,gen,0.5);
+  ComplexVector hw(extents[nwalk]);
+  RNG rng(4321);
+  base::sample_auxiliary_fields(rng,100,7,vbias,X,hw,0.3);
+  CMatrix vb(extents[nchol][nwalk-nb]), Xb(extents[nchol][nwalk-nb]);
+  vb = vbias[ indices[range_t()][range_t(nb,nwalk)] ];
+  ComplexVector hwb(extents[nwalk-nb]);
+  base::sample_auxiliary_fields(rng,100+nb,7,vb,Xb,hwb,0.3);
+  CMatrix Xref(extents[nchol][nwalk-nb]);
+  Xref = X[ indices[range_t()][range_t(nb,nwalk)] ];
+  check_equal(Xb,Xref,0.0);
+  for(int w=0; w<nwalk-nb; w++) {
+    REQUIRE(hwb[w].real() == hw[nb+w].real());
+    REQUIRE(hwb[w].imag() == hw[nb+w].imag());
+  }
+}
+
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the storage formats of MatrixOperator and of their automatic selection
+// against a dense reference product.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "Matrix/MatrixOperator.hpp"
+#include "Numerics/tests/kernel_test_helpers.h"
+
+namespace qmcplusplus
+{
+
+TEST_CASE("matrix_operator_formats", "[afqmc_kernels]")
+{
+  std::mt19937 gen(11);
+  // small chunks and windows, so that SELL has padding and sorted rows,
+  // and chunks longer than the slices of the SELL kernels
+  for(double density: {0.05, 0.3})
+   for(int chunk: {4, 24}) {
+    MatrixOperator<ComplexType> A;
+    A.set_sell_parameters(chunk,8);
+    CMatrix D;
+    random_operator(A,D,37,23,density,gen);
+    for(char op: {'N','T'}) {
+      CMatrix B(extents[(op=='N')?23:37][5]);
+      fill_random(B,gen);
+      CMatrix ref = reference_product(op,D,B);
+      for(auto f: {storage_csr, storage_sell, storage_dense}) {
+        A.set_storage(f,true);
+        CMatrix C(extents[ref.shape()[0]][5]);
+        A.product(op,ComplexType(1.0),B,ComplexType(0.0),C);
+        check_equal(C,ref);
+      }
+    }
+  }
+}
+
+TEST_CASE("matrix_operator_select_storage", "[afqmc_kernels]")
+{
+  std::mt19937 gen(13);
+  MatrixOperator<ComplexType> A;
+  CMatrix D;
+  random_operator(A,D,40,30,0.02,gen);
+  REQUIRE(A.csr().size() > 0);
+  // below min_dense_fill, dense storage is never selected
+  matrix_storage f = select_storage(A,"NT",8);
+  REQUIRE(f != storage_dense);
+  REQUIRE(A.storage() == f);
+  CMatrix B(extents[30][8]);
+  fill_random(B,gen);
+  CMatrix C(extents[40][8]);
+  A.product('N',ComplexType(1.0),B,ComplexType(0.0),C);
+  check_equal(C,reference_product('N',D,B));
+
+  // a full matrix can be selected as dense, products are the same in any format
+  MatrixOperator<ComplexType> F;
+  random_operator(F,D,40,30,1.0,gen);
+  f = select_storage(F,"N",8,0.5);
+  REQUIRE(F.storage() == f);
+  F.product('N',ComplexType(1.0),B,ComplexType(0.0),C);
+  check_equal(C,reference_product('N',D,B));
+}
+
+}
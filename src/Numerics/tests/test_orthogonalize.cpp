@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the orthogonalization methods against the LQ factorization.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "AFQMC/orthogonalize.hpp"
+#include "Utilities/ScratchArena.h"
+#include "Numerics/tests/kernel_test_helpers.h"
+
+namespace qmcplusplus
+{
+
+// Q*H(Q), the projector on the column space of Q
+CMatrix projector(const CMatrix& Q)
+{
+  int nr = Q.shape()[0], nc = Q.shape()[1];
+  CMatrix P(extents[nr][nr]);
+  for(int i=0; i<nr; i++)
+    for(int j=0; j<nr; j++) {
+      ComplexType s(0);
+      for(int k=0; k<nc; k++) s += Q[i][k]*std::conj(Q[j][k]);
+      P[i][j] = s;
+    }
+  return P;
+}
+
+TEST_CASE("orthogonalize_methods", "[afqmc_kernels]")
+{
+  const int NMO = 20, NAEA = 6;
+  std::mt19937 gen(23);
+  CMatrix A(extents[NMO][NAEA]);
+  fill_random(A,gen);
+
+  // LQ is the baseline
+  CMatrix Q0(A);
+  CMatrix NN(extents[NAEA][NAEA]);
+  int lwork = std::max(ma::gelqf_optimal_workspace_size(Q0),ma::glq_optimal_workspace_size(Q0));
+  ScratchScope scratch;
+  auto TAU = scratch.vector<ComplexType>(NMO);
+  auto WORK = scratch.buffer<ComplexType>(lwork);
+  ComplexType ld0 = base::OrthogonalizeLQ(Q0,TAU,WORK);
+  CMatrix P0 = projector(Q0);
+
+  CMatrix Q1(A);
+  ComplexType ld1(0);
+  REQUIRE(base::OrthogonalizeCholQR2(Q1,NN,ld1));
+  CMatrix Q2(A);
+  auto r = scratch.vector<ComplexType>(NAEA);
+  ComplexType ld2 = base::OrthogonalizeMGS(Q2,r);
+
+  // same column space and |det(R)|, the phases of the columns may differ
+  for(auto Q: {&Q1, &Q2}) {
+    CMatrix S(extents[NAEA][NAEA]);
+    for(int i=0; i<NAEA; i++)
+      for(int j=0; j<NAEA; j++) {
+        ComplexType s(0);
+        for(int k=0; k<NMO; k++) s += std::conj((*Q)[k][i])*(*Q)[k][j];
+        S[i][j] = s;
+      }
+    for(int i=0; i<NAEA; i++)
+      for(int j=0; j<NAEA; j++)
+        REQUIRE(std::abs(S[i][j]-ComplexType(i==j?1.0:0.0)) < 1e-10);
+    check_equal(projector(*Q),P0);
+  }
+  REQUIRE(ld1.real() == Approx(ld0.real()));
+  REQUIRE(ld2.real() == Approx(ld0.real()));
+}
+
+}
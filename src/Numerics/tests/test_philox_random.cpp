@@ -0,0 +1,49 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the streams of the counter-based random number generator.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "Utilities/RandomGenerator.h"
+
+#include <vector>
+
+namespace qmcplusplus
+{
+
+TEST_CASE("philox_streams", "[afqmc_kernels]")
+{
+  typedef PhiloxRandom<RealType> RNG;
+  const int n = 37;
+  std::vector<RealType> a(n), b(n), c(n);
+
+  // a position of a stream is reproduced whatever was generated before
+  RNG r1(1234), r2(1234);
+  r1.set_stream(5);
+  r1.set_counter(uint64_t(3)<<32);
+  r1.generate_normal(a.data(),n);
+  r2.set_stream(9);
+  r2.generate_normal(c.data(),n);
+  r2.set_stream(5);
+  r2.set_counter(uint64_t(3)<<32);
+  r2.generate_normal(b.data(),n);
+  for(int i=0; i<n; i++)
+    REQUIRE(a[i] == b[i]);
+  // different streams give different numbers
+  int nsame = 0;
+  for(int i=0; i<n; i++)
+    if(a[i] == c[i]) nsame++;
+  REQUIRE(nsame < n);
+}
+
+}
@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the planar complex storage: sparse products and auxiliary fields
+// against their interleaved versions.
+
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include "Matrix/MatrixOperator.hpp"
+#include "Matrix/PlanarMatrix.hpp"
+#include "AFQMC/force_bias.hpp"
+#include "Utilities/RandomGenerator.h"
+#include "Numerics/tests/kernel_test_helpers.h"
+
+namespace qmcplusplus
+{
+
+TEST_CASE("planar_products", "[afqmc_kernels]")
+{
+  std::mt19937 gen(17);
+  for(int chunk: {4, 24}) {
+    MatrixOperator<ComplexType> A;
+    A.set_sell_parameters(chunk,8);
+    CMatrix D;
+    random_operator(A,D,29,19,0.2,gen);
+    for(char op: {'N','T'}) {
+      int nb = (op=='N')?19:29, nc = (op=='N')?29:19;
+      CMatrix B(extents[nb][6]), C0(extents[nc][6]), C(extents[nc][6]);
+      fill_random(B,gen);
+      fill_random(C0,gen);
+      PlanarMatrix<RealType> Bp(nb,6), Cp(nc,6);
+      to_planar(B,Bp);
+      const PlanarMatrix<RealType>& Bc = Bp;
+      ComplexType alpha(0.5,-1.0), beta(2.0,0.5);
+      for(auto f: {storage_csr, storage_sell, storage_dense}) {
+        A.set_storage(f,true);
+        C = C0;
+        A.product(op,alpha,B,beta,C);
+        to_planar(C0,Cp);
+        A.product_planar(op,alpha,Bc.ref(),beta,Cp.ref());
+        CMatrix Cf(extents[nc][6]);
+        from_planar(Cp,Cf);
+        check_equal(Cf,C);
+      }
+    }
+  }
+}
+
+TEST_CASE("planar_auxiliary_fields", "[afqmc_kernels]")
+{
+  // planar version of sample_auxiliary_fields, same fields
+  const int nchol = 11, nwalk = 21;
+  std::mt19937 gen(19);
+  CMatrix vbias(extents[nchol][nwalk]), X(extents[nchol][nwalk]);
+  fill_random(vbias,gen,0.5);
+  ComplexVector hw(extents[nwalk]);
+  PhiloxRandom<RealType> rng(4321);
+  base::sample_auxiliary_fields(rng,100,7,vbias,X,hw,0.3);
+  PlanarMatrix<RealType> vp(nchol,nwalk), Xp(nchol,nwalk);
+  to_planar(vbias,vp);
+  base::sample_auxiliary_fields(rng,100,7,vp,Xp,hw,0.3);
+  CMatrix Xf(extents[nchol][nwalk]);
+  from_planar(Xp,Xf);
+  check_equal(Xf,X,1e-12);
+}
+
+}
@@ -30,6 +30,7 @@
 #include <map>
 #include <limits>
 #include <cstdio>
+#include <cmath>
 
 namespace qmcplusplus
 {
@@ -72,6 +73,7 @@ void TimerManagerClass::addTimer(NewTimer *t)
     }
     t->set_manager(this);
     t->set_active_by_timer_threshold(timer_threshold);
+    t->set_counters_by_threshold(counter_threshold);
     TimerList.push_back(t);
   }
 }
@@ -86,41 +88,111 @@ NewTimer *TimerManagerClass::createTimer(const std::string &myname,
 
 void TimerManagerClass::reset()
 {
-  for (int i = 0; i < TimerList.size(); i++)
+  for (std::size_t i = 0; i < TimerList.size(); i++)
     TimerList[i]->reset();
 }
 
 void TimerManagerClass::set_timer_threshold(const timer_levels threshold)
 {
   timer_threshold = threshold;
-  for (int i = 0; i < TimerList.size(); i++)
+  for (std::size_t i = 0; i < TimerList.size(); i++)
   {
     TimerList[i]->set_active_by_timer_threshold(timer_threshold);
   }
 }
 
+void TimerManagerClass::set_counter_threshold(const timer_levels threshold)
+{
+  counter_threshold = threshold;
+  for (std::size_t i = 0; i < TimerList.size(); i++)
+  {
+    TimerList[i]->set_counters_by_threshold(counter_threshold);
+  }
+}
+
 void TimerManagerClass::collate_flat_profile(FlatProfileData &p)
 {
-  for (int i = 0; i < TimerList.size(); ++i)
+  for (std::size_t i = 0; i < TimerList.size(); ++i)
   {
     NewTimer &timer = *TimerList[i];
+    // time measured by threads is summed over threads
+    double time = timer.get_total();
+    long calls  = timer.get_num_calls();
+    for (int ip = 0; ip < timer.get_num_threads(); ip++)
+    {
+      time += timer.get_thread_total(ip);
+      calls += timer.get_thread_num_calls(ip);
+    }
     nameList_t::iterator it(p.nameList.find(timer.get_name()));
     if (it == p.nameList.end())
     {
       int ind                      = p.nameList.size();
       p.nameList[timer.get_name()] = ind;
-      p.timeList.push_back(timer.get_total());
-      p.callList.push_back(timer.get_num_calls());
+      p.timeList.push_back(time);
+      p.callList.push_back(calls);
+      p.flopList.push_back(timer.get_flops());
+      p.byteList.push_back(timer.get_bytes());
+      for (int c = 0; c < num_perf_counters; c++)
+        p.counterList[c].push_back(timer.get_counter(c));
     }
     else
     {
       int ind = (*it).second;
-      p.timeList[ind] += timer.get_total();
-      p.callList[ind] += timer.get_num_calls();
+      p.timeList[ind] += time;
+      p.callList[ind] += calls;
+      p.flopList[ind] += timer.get_flops();
+      p.byteList[ind] += timer.get_bytes();
+      for (int c = 0; c < num_perf_counters; c++)
+        p.counterList[c][ind] += timer.get_counter(c);
     }
   }
 }
 
+void TimerManagerClass::collate_thread_profile(ThreadProfileData &p)
+{
+  // per-thread times of timers with the same name are added before taking
+  // the statistics
+  std::map<std::string, std::vector<double> > thread_times;
+  std::map<std::string, long> thread_calls;
+  int nthreads = omp_get_max_threads();
+  for (std::size_t i = 0; i < TimerList.size(); ++i)
+  {
+    NewTimer &timer = *TimerList[i];
+    long calls      = 0;
+    for (int ip = 0; ip < timer.get_num_threads(); ip++)
+      calls += timer.get_thread_num_calls(ip);
+    if (calls == 0) continue;
+    nthreads                       = std::max(nthreads, timer.get_num_threads());
+    std::vector<double> &times     = thread_times[timer.get_name()];
+    times.resize(std::max<size_t>(times.size(), timer.get_num_threads()), 0.0);
+    for (int ip = 0; ip < timer.get_num_threads(); ip++)
+      times[ip] += timer.get_thread_total(ip);
+    thread_calls[timer.get_name()] += calls;
+  }
+
+  p.nthreads = nthreads;
+  std::map<std::string, std::vector<double> >::iterator ti =
+      thread_times.begin();
+  for (; ti != thread_times.end(); ++ti)
+  {
+    std::vector<double> &times = ti->second;
+    times.resize(nthreads, 0.0);
+    double tmin = times[0], tmax = times[0], tsum = 0.0;
+    for (int ip = 0; ip < nthreads; ip++)
+    {
+      tmin = std::min(tmin, times[ip]);
+      tmax = std::max(tmax, times[ip]);
+      tsum += times[ip];
+    }
+    p.nameList[ti->first] = p.names.size();
+    p.names.push_back(ti->first);
+    p.minList.push_back(tmin);
+    p.maxList.push_back(tmax);
+    p.meanList.push_back(tsum / nthreads);
+    p.callList.push_back(thread_calls[ti->first]);
+  }
+}
+
 struct ProfileData
 {
   double time;
@@ -137,7 +209,7 @@ struct ProfileData
 int get_level(const std::string &stack_name)
 {
   int level = 0;
-  for (int i = 0; i < stack_name.length(); i++)
+  for (std::size_t i = 0; i < stack_name.length(); i++)
   {
     if (stack_name[i] == TIMER_STACK_SEPARATOR)
     {
@@ -149,7 +221,7 @@ int get_level(const std::string &stack_name)
 
 std::string get_leaf_name(const std::string &stack_name)
 {
-  int pos = stack_name.find_last_of(TIMER_STACK_SEPARATOR);
+  std::size_t pos = stack_name.find_last_of(TIMER_STACK_SEPARATOR);
   if (pos == std::string::npos)
   {
     return stack_name;
@@ -183,7 +255,7 @@ void TimerManagerClass::collate_stack_profile(StackProfileData &p)
   // The order in which sibling timers are encountered in the code is not
   // preserved. They will be ordered alphabetically instead.
   std::map<std::string, ProfileData> all_stacks;
-  for (int i = 0; i < TimerList.size(); ++i)
+  for (std::size_t i = 0; i < TimerList.size(); ++i)
   {
     NewTimer &timer = *TimerList[i];
     std::map<StackKey, double>::iterator stack_id_it =
@@ -203,7 +275,7 @@ void TimerManagerClass::collate_stack_profile(StackProfileData &p)
 
   // Fill in the output data structure (but don't compute exclusive time yet)
   std::map<std::string, ProfileData>::iterator si = all_stacks.begin();
-  int idx = 0;
+  std::size_t idx = 0;
   for (; si != all_stacks.end(); ++si)
   {
     std::string stack_name = si->first;
@@ -219,7 +291,7 @@ void TimerManagerClass::collate_stack_profile(StackProfileData &p)
   for (idx = 0; idx < p.timeList.size(); idx++)
   {
     int start_level = get_level(p.names[idx]);
-    for (int i = idx + 1; i < p.timeList.size(); i++)
+    for (std::size_t i = idx + 1; i < p.timeList.size(); i++)
     {
       int level = get_level(p.names[i]);
       if (level == start_level + 1)
@@ -245,6 +317,9 @@ void TimerManagerClass::print()
   printf("\nFlat profile\n");
   print_flat();
 #endif
+  print_threads();
+  print_work();
+  print_counters();
 #endif
 }
 
@@ -302,7 +377,7 @@ void TimerManagerClass::print_stack()
 
     int indent_len   = 2;
     int max_name_len = 0;
-    for (int i = 0; i < p.names.size(); i++)
+    for (std::size_t i = 0; i < p.names.size(); i++)
     {
       std::string stack_name = p.names[i];
       int level              = get_level(stack_name);
@@ -315,7 +390,7 @@ void TimerManagerClass::print_stack()
     pad_string("Timer", timer_name, max_name_len);
     printf("%s  %-9s  %-9s  %-10s  %-13s\n", timer_name.c_str(),
            "Inclusive_time", "Exclusive_time", "Calls", "Time_per_call");
-    for (int i = 0; i < p.names.size(); i++)
+    for (std::size_t i = 0; i < p.names.size(); i++)
     {
       std::string stack_name = p.names[i];
       int level              = get_level(stack_name);
@@ -333,6 +408,291 @@ void TimerManagerClass::print_stack()
 #endif
 }
 
+double imbalance(double tmax, double tmean)
+{
+  return (tmean > 0.0) ? tmax / tmean - 1.0 : 0.0;
+}
+
+void TimerManagerClass::print_threads()
+{
+#if ENABLE_TIMERS
+  ThreadProfileData p;
+
+  collate_thread_profile(p);
+
+  if (p.names.size() == 0) return;
+
+  int max_name_len = 5;
+  for (std::size_t i = 0; i < p.names.size(); i++)
+    max_name_len = std::max(max_name_len, static_cast<int>(p.names[i].size()));
+
+  printf("\nThread profile (%d threads)\n", p.nthreads);
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-9s  %-9s  %-9s  %-9s  %-13s\n", timer_name.c_str(), "Min_time",
+         "Max_time", "Mean_time", "Imbalance", "Calls");
+  for (std::size_t i = 0; i < p.names.size(); i++)
+  {
+    std::string padded_name_str;
+    pad_string(p.names[i], padded_name_str, max_name_len);
+    printf("%s  %9.4f  %9.4f  %9.4f  %9.4f  %13ld\n", padded_name_str.c_str(),
+           p.minList[i], p.maxList[i], p.meanList[i],
+           imbalance(p.maxList[i], p.meanList[i]), p.callList[i]);
+  }
+#endif
+}
+
+// rate in units of 1e9/second, 0 for timers that did not run
+double giga_rate(double x, double time)
+{
+  return (time > 0.0) ? x / time * 1e-9 : 0.0;
+}
+
+void TimerManagerClass::print_work()
+{
+#if ENABLE_TIMERS
+  FlatProfileData p;
+
+  collate_flat_profile(p);
+
+  int max_name_len = 5;
+  bool any_work    = false;
+  nameList_t::iterator it(p.nameList.begin()), it_end(p.nameList.end());
+  for (; it != it_end; ++it)
+  {
+    if (p.flopList[(*it).second] > 0.0 || p.byteList[(*it).second] > 0.0)
+    {
+      any_work     = true;
+      max_name_len = std::max(max_name_len, static_cast<int>((*it).first.size()));
+    }
+  }
+  if (!any_work) return;
+
+  // times of thread timers are summed over threads, so their rates are per thread
+  printf("\nKernel throughput\n");
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-9s  %-11s  %-9s  %-9s  %-9s\n", timer_name.c_str(), "Time",
+         "GFLOP", "GFLOP/s", "GB/s", "Flop/Byte");
+  for (it = p.nameList.begin(); it != it_end; ++it)
+  {
+    int i = (*it).second;
+    if (p.flopList[i] <= 0.0 && p.byteList[i] <= 0.0) continue;
+    std::string padded_name_str;
+    pad_string((*it).first, padded_name_str, max_name_len);
+    printf("%s  %9.4f  %11.4f  %9.3f  %9.3f  %9.3f\n", padded_name_str.c_str(),
+           p.timeList[i], p.flopList[i] * 1e-9,
+           giga_rate(p.flopList[i], p.timeList[i]),
+           giga_rate(p.byteList[i], p.timeList[i]),
+           (p.byteList[i] > 0.0) ? p.flopList[i] / p.byteList[i] : 0.0);
+  }
+#endif
+}
+
+void TimerManagerClass::print_counters()
+{
+#if ENABLE_TIMERS
+  if (!perf_counters::enabled() || counter_threshold == timer_level_none)
+    return;
+
+  FlatProfileData p;
+
+  collate_flat_profile(p);
+
+  int max_name_len = 5;
+  nameList_t::iterator it(p.nameList.begin()), it_end(p.nameList.end());
+  for (; it != it_end; ++it)
+    if (p.counterList[perf_cycles][(*it).second] > 0.0)
+      max_name_len = std::max(max_name_len, static_cast<int>((*it).first.size()));
+
+  // LLC misses are converted to memory traffic assuming 64 byte lines
+  printf("\nHardware counters%s\n",
+         perf_counters::available(perf_fp_ops) ? "" : " (fp_ops not available)");
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-10s  %-10s  %-6s  %-11s  %-9s  %-9s  %-9s\n", timer_name.c_str(),
+         "Gcycles", "Ginstr", "IPC", "LLC_misses", "LLC_GB/s", "Flop/cyc",
+         "GFLOP/s");
+  for (it = p.nameList.begin(); it != it_end; ++it)
+  {
+    int i         = (*it).second;
+    double cycles = p.counterList[perf_cycles][i];
+    if (cycles <= 0.0) continue;
+    double instr  = p.counterList[perf_instructions][i];
+    double misses = p.counterList[perf_llc_misses][i];
+    double fp     = p.counterList[perf_fp_ops][i];
+    std::string padded_name_str;
+    pad_string((*it).first, padded_name_str, max_name_len);
+    printf("%s  %10.4f  %10.4f  %6.3f  %11.0f  %9.3f  %9.3f  %9.3f\n",
+           padded_name_str.c_str(), cycles * 1e-9, instr * 1e-9, instr / cycles,
+           misses, giga_rate(64.0 * misses, p.timeList[i]), fp / cycles,
+           giga_rate(fp, p.timeList[i]));
+  }
+#endif
+}
+
+std::string json_string(const std::string &in)
+{
+  std::string out("\"");
+  for (std::size_t i = 0; i < in.size(); i++)
+  {
+    char c = in[i];
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+    else
+      out += c;
+  }
+  return out + "\"";
+}
+
+std::string csv_string(const std::string &in)
+{
+  if (in.find_first_of(",\"\n") == std::string::npos) return in;
+  std::string out("\"");
+  for (std::size_t i = 0; i < in.size(); i++)
+  {
+    if (in[i] == '"') out += '"';
+    out += in[i];
+  }
+  return out + "\"";
+}
+
+// json has no representation for nan/inf
+std::string number_string(double x)
+{
+  if (!std::isfinite(x)) return "null";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", x);
+  return buf;
+}
+
+void TimerManagerClass::write_json(std::ostream &out)
+{
+#if ENABLE_TIMERS
+  FlatProfileData pf;
+  StackProfileData ps;
+  ThreadProfileData pt;
+  collate_flat_profile(pf);
+  collate_stack_profile(ps);
+  collate_thread_profile(pt);
+
+  out << "{\n";
+  out << "  \"max_stack_level_exceeded\": "
+      << (timer_max_level_exceeded ? "true" : "false") << ",\n";
+  out << "  \"max_timers_exceeded\": "
+      << (max_timers_exceeded ? "true" : "false") << ",\n";
+  out << "  \"nthreads\": " << pt.nthreads << ",\n";
+
+  out << "  \"flat\": [";
+  nameList_t::iterator it(pf.nameList.begin()), it_end(pf.nameList.end());
+  for (bool first = true; it != it_end; ++it, first = false)
+  {
+    int i = (*it).second;
+    out << (first ? "\n" : ",\n") << "    {\"name\": " << json_string((*it).first)
+        << ", \"time\": " << number_string(pf.timeList[i])
+        << ", \"calls\": " << pf.callList[i]
+        << ", \"flops\": " << number_string(pf.flopList[i])
+        << ", \"bytes\": " << number_string(pf.byteList[i])
+        << ", \"gflops\": "
+        << number_string(giga_rate(pf.flopList[i], pf.timeList[i]))
+        << ", \"gbytes_per_sec\": "
+        << number_string(giga_rate(pf.byteList[i], pf.timeList[i]));
+    if (perf_counters::enabled())
+      for (int c = 0; c < num_perf_counters; c++)
+        out << ", \"" << perf_counters::name(c)
+            << "\": " << number_string(pf.counterList[c][i]);
+    out << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"stack\": [";
+  for (std::size_t i = 0; i < ps.names.size(); i++)
+  {
+    out << (i == 0 ? "\n" : ",\n") << "    {\"name\": "
+        << json_string(get_leaf_name(ps.names[i]))
+        << ", \"path\": " << json_string(ps.names[i])
+        << ", \"level\": " << get_level(ps.names[i])
+        << ", \"time_incl\": " << number_string(ps.timeList[i])
+        << ", \"time_excl\": " << number_string(ps.timeExclList[i])
+        << ", \"calls\": " << ps.callList[i] << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"threads\": [";
+  for (std::size_t i = 0; i < pt.names.size(); i++)
+  {
+    out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << json_string(pt.names[i])
+        << ", \"min\": " << number_string(pt.minList[i])
+        << ", \"max\": " << number_string(pt.maxList[i])
+        << ", \"mean\": " << number_string(pt.meanList[i])
+        << ", \"imbalance\": "
+        << number_string(imbalance(pt.maxList[i], pt.meanList[i]))
+        << ", \"calls\": " << pt.callList[i] << "}";
+  }
+  out << "\n  ]\n";
+  out << "}\n";
+#endif
+}
+
+void TimerManagerClass::write_csv(std::ostream &out)
+{
+#if ENABLE_TIMERS
+  FlatProfileData pf;
+  StackProfileData ps;
+  ThreadProfileData pt;
+  collate_flat_profile(pf);
+  collate_stack_profile(ps);
+  collate_thread_profile(pt);
+
+  // one table, unused columns are left empty
+  out << "profile,name,level,time_incl,time_excl,calls,min,max,mean,"
+         "imbalance,flops,bytes";
+  for (int c = 0; c < num_perf_counters; c++)
+    out << "," << perf_counters::name(c);
+  out << "\n";
+  // empty hardware counter columns
+  std::string no_counters(num_perf_counters, ',');
+  nameList_t::iterator it(pf.nameList.begin()), it_end(pf.nameList.end());
+  for (; it != it_end; ++it)
+  {
+    int i = (*it).second;
+    out << "flat," << csv_string((*it).first) << ",0,"
+        << number_string(pf.timeList[i]) << ",," << pf.callList[i] << ",,,,,"
+        << number_string(pf.flopList[i]) << "," << number_string(pf.byteList[i]);
+    for (int c = 0; c < num_perf_counters; c++)
+    {
+      out << ",";
+      if (perf_counters::enabled()) out << number_string(pf.counterList[c][i]);
+    }
+    out << "\n";
+  }
+  for (std::size_t i = 0; i < ps.names.size(); i++)
+  {
+    out << "stack," << csv_string(ps.names[i]) << "," << get_level(ps.names[i])
+        << "," << number_string(ps.timeList[i]) << ","
+        << number_string(ps.timeExclList[i]) << "," << ps.callList[i]
+        << ",,,,,," << no_counters << "\n";
+  }
+  for (std::size_t i = 0; i < pt.names.size(); i++)
+  {
+    out << "threads," << csv_string(pt.names[i]) << ",0,,," << pt.callList[i]
+        << "," << number_string(pt.minList[i]) << ","
+        << number_string(pt.maxList[i]) << "," << number_string(pt.meanList[i])
+        << "," << number_string(imbalance(pt.maxList[i], pt.meanList[i]))
+        << ",," << no_counters << "\n";
+  }
+#endif
+}
+
 // Might want some sort of structured output for timing data - either xml or
 // yaml
 #if 0
@@ -354,7 +714,7 @@ TimerManagerClass::output_timing(Communicate *comm, Libxml2Document &doc, xmlNod
     node_stack.push_back(timing_root);
     xmlNodePtr current_root = timing_root;
 
-    for (int i = 0; i < p.names.size(); i++)
+    for (std::size_t i = 0; i < p.names.size(); i++)
     {
       std::string stack_name = p.names[i];
       int level = get_level(stack_name);
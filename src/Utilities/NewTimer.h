@@ -111,17 +111,61 @@
  * The 'coarse' level is the default.
  * Typically a command line option will be used to adjust this level.
  *
+ * ### Timing inside parallel regions
+ *
+ * start/stop only record the master thread and build the timer stack.
+ * Code executed by every thread (or by OpenMP tasks) is timed with
+ * thread_start/thread_stop, which accumulate into per-thread slots.
+ * The slots are merged when the profiles are collated: the flat profile
+ * reports the sum over threads, the thread profile reports the
+ * min/max/mean over threads and the load imbalance (max/mean - 1).
+ * @code
+ * #pragma omp parallel
+ * {
+ *   timer1->thread_start();
+ *   // Code to be timed
+ *   timer1->thread_stop();
+ * }
+ * @endcode
+ *
+ * ### Work counters
+ *
+ * Kernels can attach the (analytic) number of floating point operations and
+ * bytes moved in each call with add_work. The flat profile then reports
+ * GFLOP/s and GB/s of the timer. It can be called by any thread.
+ * @code
+ * timer1->start();
+ * gemm(M,N,K,...);
+ * timer1->stop();
+ * timer1->add_work(8.0*M*N*K, 16.0*(M*K+K*N+M*N));
+ * @endcode
+ *
+ * ### Hardware counters
+ *
+ * Timers at or below the level set with TimerManager.set_counter_threshold
+ * also read the hardware counters of the timing thread (see PerfCounters.h)
+ * at start/stop and thread_start/thread_stop. The default is
+ * timer_level_none, no counters are read. Counters must be enabled with
+ * perf_counters::enable() first.
+ *
+ * ### Output
+ *
+ * TimerManager.print() writes the profiles to stdout, write_json and write_csv
+ * write the flat, stack and thread profiles in machine-readable form.
+ *
  */
 #ifndef QMCPLUSPLUS_NEW_TIMER_H
 #define QMCPLUSPLUS_NEW_TIMER_H
 
 #include <Utilities/Clock.h>
+#include <Utilities/PerfCounters.h>
 //#include <OhmmsData/Libxml2Doc.h>
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <map>
 #include <iostream>
+#include <ostream>
 
 #ifdef USE_VTUNE_TASKS
 #include <ittnotify.h>
@@ -231,6 +275,7 @@ protected:
   std::vector<NewTimer *> TimerList;
   std::vector<NewTimer *> CurrentTimerStack;
   timer_levels timer_threshold;
+  timer_levels counter_threshold;
   timer_id_t max_timer_id;
   bool max_timers_exceeded;
   std::map<timer_id_t, std::string> timer_id_name;
@@ -242,7 +287,8 @@ public:
 #endif
 
   TimerManagerClass()
-      : timer_threshold(timer_level_coarse), max_timer_id(1),
+      : timer_threshold(timer_level_coarse),
+        counter_threshold(timer_level_none), max_timer_id(1),
         max_timers_exceeded(false)
   {
 #ifdef USE_VTUNE_TASKS
@@ -279,6 +325,8 @@ public:
 
   void set_timer_threshold(const timer_levels threshold);
 
+  void set_counter_threshold(const timer_levels threshold);
+
   bool maximum_number_of_timers_exceeded() const { return max_timers_exceeded; }
 
   void reset();
@@ -296,6 +344,9 @@ public:
     nameList_t nameList;
     timeList_t timeList;
     callList_t callList;
+    timeList_t flopList;
+    timeList_t byteList;
+    timeList_t counterList[num_perf_counters];
   };
 
   struct StackProfileData
@@ -307,10 +358,32 @@ public:
     callList_t callList;
   };
 
+  // statistics over threads of the timers used with thread_start/thread_stop
+  struct ThreadProfileData
+  {
+    int nthreads;
+    names_t names;
+    nameList_t nameList;
+    timeList_t minList;
+    timeList_t maxList;
+    timeList_t meanList;
+    callList_t callList;
+  };
+
   void collate_flat_profile(FlatProfileData &p);
 
   void collate_stack_profile(StackProfileData &p);
 
+  void collate_thread_profile(ThreadProfileData &p);
+
+  void print_threads();
+  void print_work();
+  void print_counters();
+
+  // machine-readable dump of the flat, stack and thread profiles
+  void write_json(std::ostream &out);
+  void write_csv(std::ostream &out);
+
   // void output_timing(Communicate *comm, Libxml2Document &doc, xmlNodePtr
   // root);
 
@@ -328,6 +401,7 @@ protected:
   long num_calls;
   std::string name;
   bool active;
+  bool read_counters;
   timer_levels timer_level;
   timer_id_t timer_id;
 #ifdef USE_STACK_TIMERS
@@ -339,6 +413,34 @@ protected:
   std::map<StackKey, long> per_stack_num_calls;
 #endif
 
+  // one slot per thread, padded to a cache line to avoid false sharing
+  struct ThreadSlot
+  {
+    double start_time;
+    double total_time;
+    long num_calls;
+    double flops;
+    double bytes;
+    perf_count_t counter_start[num_perf_counters];
+    double counter_total[num_perf_counters];
+    char pad[128 - (4 + 2 * num_perf_counters) * sizeof(double) -
+             sizeof(long)];
+  };
+  std::vector<ThreadSlot> per_thread;
+
+  inline void start_counters(int ip)
+  {
+    perf_counters::read(per_thread[ip].counter_start);
+  }
+
+  inline void stop_counters(int ip)
+  {
+    perf_count_t c[num_perf_counters];
+    perf_counters::read(c);
+    for (int i = 0; i < num_perf_counters; i++)
+      per_thread[ip].counter_total[i] += c[i] - per_thread[ip].counter_start[i];
+  }
+
 #ifdef USE_VTUNE_TASKS
   __itt_string_handle *task_name;
 #endif
@@ -384,9 +486,11 @@ public:
           }
           manager->push_timer(this);
         }
+        if (read_counters) start_counters(0);
         start_time = cpu_clock();
       }
 #else
+      if (read_counters) start_counters(0);
       start_time = cpu_clock();
 #endif
     }
@@ -406,6 +510,7 @@ public:
 #endif
       {
         double elapsed = cpu_clock() - start_time;
+        if (read_counters) stop_counters(0);
         total_time += elapsed;
         num_calls++;
 
@@ -424,6 +529,92 @@ public:
   }
 #endif
 
+#if not(ENABLE_TIMERS)
+  inline void thread_start() {}
+  inline void thread_stop() {}
+#else
+  // can be called by any thread, does not take part in the timer stack
+  inline void thread_start()
+  {
+    if (active)
+    {
+      std::size_t ip = omp_get_thread_num();
+      if (ip < per_thread.size())
+      {
+        if (read_counters) start_counters(ip);
+        per_thread[ip].start_time = cpu_clock();
+      }
+    }
+  }
+
+  inline void thread_stop()
+  {
+    if (active)
+    {
+      std::size_t ip = omp_get_thread_num();
+      if (ip < per_thread.size())
+      {
+        per_thread[ip].total_time += cpu_clock() - per_thread[ip].start_time;
+        if (read_counters) stop_counters(ip);
+        per_thread[ip].num_calls++;
+      }
+    }
+  }
+#endif
+
+  // adds floating point operations and bytes moved to the calling thread's slot
+  inline void add_work(double nflops, double nbytes)
+  {
+#if ENABLE_TIMERS
+    if (active)
+    {
+      std::size_t ip = omp_get_thread_num();
+      if (ip < per_thread.size())
+      {
+        per_thread[ip].flops += nflops;
+        per_thread[ip].bytes += nbytes;
+      }
+    }
+#endif
+  }
+
+  inline int get_num_threads() const { return per_thread.size(); }
+
+  inline double get_thread_total(int ip) const
+  {
+    return per_thread[ip].total_time;
+  }
+
+  inline long get_thread_num_calls(int ip) const
+  {
+    return per_thread[ip].num_calls;
+  }
+
+  inline double get_flops() const
+  {
+    double f = 0.0;
+    for (std::size_t i = 0; i < per_thread.size(); i++)
+      f += per_thread[i].flops;
+    return f;
+  }
+
+  inline double get_bytes() const
+  {
+    double b = 0.0;
+    for (std::size_t i = 0; i < per_thread.size(); i++)
+      b += per_thread[i].bytes;
+    return b;
+  }
+
+  // hardware counter id summed over threads
+  inline double get_counter(int id) const
+  {
+    double c = 0.0;
+    for (std::size_t i = 0; i < per_thread.size(); i++)
+      c += per_thread[i].counter_total[id];
+    return c;
+  }
+
 #ifdef USE_STACK_TIMERS
   std::map<StackKey, double> &get_per_stack_total_time()
   {
@@ -461,16 +652,27 @@ public:
   {
     num_calls  = 0;
     total_time = 0.0;
+    for (std::size_t i = 0; i < per_thread.size(); i++)
+    {
+      per_thread[i].total_time = 0.0;
+      per_thread[i].num_calls  = 0;
+      per_thread[i].flops      = 0.0;
+      per_thread[i].bytes      = 0.0;
+      for (int j = 0; j < num_perf_counters; j++)
+        per_thread[i].counter_total[j] = 0.0;
+    }
   }
 
   NewTimer(const std::string &myname, timer_levels mytimer = timer_level_fine)
       : total_time(0.0), num_calls(0), name(myname), active(true),
-        timer_level(mytimer), timer_id(0)
+        read_counters(false), timer_level(mytimer), timer_id(0)
 #ifdef USE_STACK_TIMERS
         ,
         manager(NULL), parent(NULL)
 #endif
   {
+    ThreadSlot zero = {};
+    per_thread.resize(omp_get_max_threads(), zero);
 #ifdef USE_VTUNE_TASKS
     task_name = __itt_string_handle_create(myname.c_str());
 #endif
@@ -482,6 +684,11 @@ public:
 
   void set_active_by_timer_threshold(const timer_levels threshold);
 
+  void set_counters_by_threshold(const timer_levels threshold)
+  {
+    read_counters = (timer_level <= threshold) && perf_counters::enabled();
+  }
+
   void set_manager(TimerManagerClass *mymanager)
   {
 #ifdef USE_STACK_TIMERS
@@ -534,7 +741,7 @@ void setup_timers(TimerList_t &timers, TimerNameList_t<T> timer_list,
                   timer_levels timer_level = timer_level_fine)
 {
   timers.resize(timer_list.size());
-  for (int i = 0; i < timer_list.size(); i++)
+  for (std::size_t i = 0; i < timer_list.size(); i++)
   {
     timers[timer_list[i].id] =
         TimerManager.createTimer(timer_list[i].name, timer_level);
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file NumaAllocator.cpp
+ * @brief Implements numa_allocate and the memory policy
+ */
+#include "Utilities/NumaAllocator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// mbind is called through syscall, so that libnuma is not required
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+namespace qmcplusplus
+{
+
+static memory_policy policy;
+
+// large blocks and whether they are backed by explicit huge pages
+static std::mutex blocks_lock;
+static std::map<void*, bool> blocks;
+static std::size_t large_bytes   = 0;
+static std::size_t hugetlb_bytes = 0;
+
+static const std::size_t page_size = 4096;
+
+// node set by numa_node_scope, -1 if none
+static thread_local int bound_node = -1;
+
+memory_policy get_memory_policy() { return policy; }
+
+void set_memory_policy(const memory_policy& p) { policy = p; }
+
+bool parse_memory_policy(const std::string& s, memory_policy& p)
+{
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    if (item == "none")
+      p.hugepages = hugepages_none;
+    else if (item == "thp")
+      p.hugepages = hugepages_transparent;
+    else if (item == "huge")
+      p.hugepages = hugepages_explicit;
+    else if (item == "default")
+      p.placement = placement_default;
+    else if (item == "first_touch")
+      p.placement = placement_first_touch;
+    else if (item == "interleave")
+      p.placement = placement_interleave;
+    else
+      return false;
+  }
+  return true;
+}
+
+std::string memory_policy_name(const memory_policy& p)
+{
+  std::string res;
+  switch (p.hugepages)
+  {
+  case hugepages_none: res = "none"; break;
+  case hugepages_transparent: res = "thp"; break;
+  case hugepages_explicit: res = "huge"; break;
+  }
+  switch (p.placement)
+  {
+  case placement_default: res += ",default"; break;
+  case placement_first_touch: res += ",first_touch"; break;
+  case placement_interleave: res += ",interleave"; break;
+  }
+  return res;
+}
+
+// nodes listed in /sys/devices/system/node/online, e.g. "0-1,4"
+static std::vector<int> online_nodes()
+{
+  std::vector<int> nodes;
+  std::ifstream in("/sys/devices/system/node/online");
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    int a = 0, b = 0;
+    int n = std::sscanf(item.c_str(), "%d-%d", &a, &b);
+    if (n == 1)
+      b = a;
+    if (n < 1 || a < 0 || b < a)
+      continue;
+    for (int i = a; i <= b; i++)
+      nodes.push_back(i);
+  }
+  if (nodes.empty())
+    nodes.push_back(0);
+  return nodes;
+}
+
+static const std::vector<int>& nodes()
+{
+  static std::vector<int> n = online_nodes();
+  return n;
+}
+
+int numa_num_nodes() { return nodes().size(); }
+
+int numa_current_node()
+{
+  unsigned cpu = 0, node = 0;
+  if (nodes().size() < 2 || syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    return 0;
+  auto it = std::find(nodes().begin(), nodes().end(), int(node));
+  return (it == nodes().end()) ? 0 : int(it - nodes().begin());
+}
+
+numa_node_scope::numa_node_scope(int node) : previous(bound_node) { bound_node = node; }
+
+numa_node_scope::~numa_node_scope() { bound_node = previous; }
+
+std::size_t numa_large_bytes()
+{
+  std::lock_guard<std::mutex> guard(blocks_lock);
+  return large_bytes;
+}
+
+std::size_t numa_hugetlb_bytes()
+{
+  std::lock_guard<std::mutex> guard(blocks_lock);
+  return hugetlb_bytes;
+}
+
+static std::size_t mapped_length(std::size_t bytes)
+{
+  return (bytes + large_block_size - 1) / large_block_size * large_block_size;
+}
+
+// mode is MPOL_INTERLEAVE over all the nodes, or MPOL_BIND to nodes()[node]
+static void bind(void* p, std::size_t len, int mode, int node = -1)
+{
+  if (nodes().size() < 2)
+    return;
+  const int bits        = 8 * sizeof(unsigned long);
+  unsigned long maxnode = nodes().back() + 2;
+  std::vector<unsigned long> mask((maxnode + bits - 1) / bits, 0ul);
+  for (std::size_t i = 0; i < nodes().size(); i++)
+    if (node < 0 || i == static_cast<std::size_t>(node) % nodes().size())
+      mask[nodes()[i] / bits] |= 1ul << (nodes()[i] % bits);
+  // placement is only a hint, failures (e.g. in containers without the capability) are ignored
+  syscall(SYS_mbind, p, len, mode, mask.data(), maxnode, 0);
+}
+
+void* numa_allocate(std::size_t bytes)
+{
+  if (bytes < large_block_size)
+  {
+    void* p = std::malloc(bytes > 0 ? bytes : 1);
+    if (p == nullptr)
+      throw std::bad_alloc();
+    return p;
+  }
+  std::size_t len = mapped_length(bytes);
+  memory_policy pol = policy;
+  void* p           = MAP_FAILED;
+  bool hugetlb      = false;
+#ifdef MAP_HUGETLB
+  if (pol.hugepages == hugepages_explicit)
+  {
+    p       = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    hugetlb = (p != MAP_FAILED);
+  }
+#endif
+  if (p == MAP_FAILED)
+    p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+  if (!hugetlb && pol.hugepages != hugepages_none)
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+  if (bound_node >= 0)
+    bind(p, len, MPOL_BIND, bound_node);
+  else if (pol.placement == placement_interleave)
+    bind(p, len, MPOL_INTERLEAVE);
+  else if (pol.placement == placement_first_touch)
+  {
+    // pages are placed on the node of the thread that touches them first
+    char* c     = static_cast<char*>(p);
+    long npages = (bytes + page_size - 1) / page_size;
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < npages; i++)
+      c[i * page_size] = 0;
+  }
+  std::lock_guard<std::mutex> guard(blocks_lock);
+  blocks[p] = hugetlb;
+  large_bytes += len;
+  if (hugetlb)
+    hugetlb_bytes += len;
+  return p;
+}
+
+void numa_deallocate(void* p, std::size_t bytes)
+{
+  if (p == nullptr)
+    return;
+  if (bytes < large_block_size)
+  {
+    std::free(p);
+    return;
+  }
+  std::size_t len = mapped_length(bytes);
+  {
+    std::lock_guard<std::mutex> guard(blocks_lock);
+    auto it = blocks.find(p);
+    if (it != blocks.end())
+    {
+      if (it->second)
+        hugetlb_bytes -= len;
+      blocks.erase(it);
+    }
+    large_bytes -= len;
+  }
+  munmap(p, len);
+}
+
+}
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file NumaAllocator.h
+ * @brief Allocator with huge page and NUMA placement control for large arrays
+ *
+ * Blocks of at least large_block_size bytes are mapped directly with mmap and
+ * placed according to the global memory_policy:
+ *  - huge pages: none, transparent (madvise(MADV_HUGEPAGE)) or explicit (MAP_HUGETLB,
+ *    falls back to transparent huge pages if no huge pages are reserved).
+ *  - placement: default (first touch by the allocating thread), first_touch (pages are
+ *    touched in an OpenMP parallel loop with a static schedule, i.e. by the threads
+ *    that process the matching part of the array in static loops) or interleave
+ *    (pages distributed round-robin over all NUMA nodes with mbind).
+ * Smaller blocks go through malloc. The policy must be set before the arrays are allocated,
+ * it can be changed at any time without affecting existing blocks.
+ * Within a numa_node_scope, large blocks allocated by the thread are bound to a given node
+ * instead, e.g. to build per-node copies of read-only data.
+ *
+ * numa_allocator is used by the matrix and walker typedefs in Configuration.h and by
+ * the storage of the sparse matrices.
+ */
+#ifndef QMCPLUSPLUS_NUMA_ALLOCATOR_H
+#define QMCPLUSPLUS_NUMA_ALLOCATOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <new>
+#include <utility>
+
+namespace qmcplusplus
+{
+
+enum hugepage_mode
+{
+  hugepages_none,
+  hugepages_transparent,
+  hugepages_explicit
+};
+
+enum numa_placement
+{
+  placement_default,
+  placement_first_touch,
+  placement_interleave
+};
+
+struct memory_policy
+{
+  hugepage_mode hugepages = hugepages_none;
+  numa_placement placement = placement_default;
+};
+
+/// blocks of at least this size are mapped with the memory policy, smaller ones use malloc
+const std::size_t large_block_size = std::size_t(1) << 21;
+
+memory_policy get_memory_policy();
+void set_memory_policy(const memory_policy& p);
+
+/**
+ * Parses a comma separated list with at most one of none, thp or huge (huge pages)
+ * and one of default, first_touch or interleave (placement), e.g. "thp,first_touch".
+ * Options not present keep their default.
+ */
+bool parse_memory_policy(const std::string& s, memory_policy& p);
+std::string memory_policy_name(const memory_policy& p);
+
+/// number of NUMA nodes available to the process
+int numa_num_nodes();
+/// index in [0,numa_num_nodes()) of the node the calling thread is running on
+int numa_current_node();
+/// bytes currently allocated in large blocks, and how many of them are backed by explicit huge pages
+std::size_t numa_large_bytes();
+std::size_t numa_hugetlb_bytes();
+
+void* numa_allocate(std::size_t bytes);
+void numa_deallocate(void* p, std::size_t bytes);
+
+/** binds large blocks allocated by the calling thread to node (an index as in numa_current_node)
+ * while the scope is alive
+ */
+class numa_node_scope
+{
+public:
+  explicit numa_node_scope(int node);
+  ~numa_node_scope();
+
+private:
+  int previous;
+
+  numa_node_scope(const numa_node_scope&) = delete;
+  numa_node_scope& operator=(const numa_node_scope&) = delete;
+};
+
+/** std allocator on top of numa_allocate
+ */
+template<class T>
+struct numa_allocator
+{
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template<class U>
+  struct rebind
+  {
+    typedef numa_allocator<U> other;
+  };
+
+  numa_allocator() = default;
+  template<class U>
+  numa_allocator(const numa_allocator<U>&) {}
+
+  T* allocate(std::size_t n, const void* = nullptr)
+  {
+    return static_cast<T*>(numa_allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) { numa_deallocate(p, n * sizeof(T)); }
+
+  std::size_t max_size() const { return std::size_t(-1) / sizeof(T); }
+
+  template<class U, class... Args>
+  void construct(U* p, Args&&... args)
+  {
+    ::new ((void*)p) U(std::forward<Args>(args)...);
+  }
+
+  template<class U>
+  void destroy(U* p)
+  {
+    p->~U();
+  }
+};
+
+template<class T, class U>
+inline bool operator==(const numa_allocator<T>&, const numa_allocator<U>&)
+{
+  return true;
+}
+
+template<class T, class U>
+inline bool operator!=(const numa_allocator<T>&, const numa_allocator<U>&)
+{
+  return false;
+}
+
+template<class T>
+using numa_vector = std::vector<T, numa_allocator<T>>;
+
+}
+
+#endif
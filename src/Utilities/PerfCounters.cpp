@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PerfCounters.cpp
+ * @brief Implements perf_counters with perf_event_open
+ */
+#include "Utilities/PerfCounters.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace qmcplusplus
+{
+namespace perf_counters
+{
+
+static bool counters_enabled = false;
+
+#if defined(__linux__)
+
+// FP_ARITH_INST_RETIRED (event 0xC7) umasks for double precision and their
+// number of flops per instruction
+static const int num_fp_events                 = 4;
+static const unsigned long fp_umask[num_fp_events] = {0x01, 0x04, 0x10, 0x40};
+static const double fp_weight[num_fp_events]       = {1.0, 2.0, 4.0, 8.0};
+
+static bool is_intel()
+{
+  std::ifstream in("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(in, line))
+    if (line.compare(0, 9, "vendor_id") == 0)
+      return line.find("GenuineIntel") != std::string::npos;
+  return false;
+}
+
+static bool use_fp_events = false;
+
+static int open_event(unsigned type, unsigned long long config, int group_fd)
+{
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = (group_fd == -1) ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/** counters of one thread, opened as a single group led by the cycles counter
+ * position[i] is the index of event i in the group, -1 if it could not be opened
+ */
+struct thread_group
+{
+  static const int max_events = 3 + num_fp_events;
+  bool opened;
+  int leader;
+  int nevents;
+  int fds[max_events];
+  int position[max_events];
+
+  thread_group() : opened(false), leader(-1), nevents(0)
+  {
+    for (int i = 0; i < max_events; i++)
+      fds[i] = position[i] = -1;
+  }
+
+  ~thread_group()
+  {
+    for (int i = 0; i < max_events; i++)
+      if (fds[i] >= 0) close(fds[i]);
+  }
+
+  void open()
+  {
+    opened = true;
+    leader = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0) return;
+    fds[0]      = leader;
+    position[0] = nevents++;
+    fds[1] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+    fds[2] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+    for (int i = 0; i < num_fp_events && use_fp_events; i++)
+      fds[3 + i] = open_event(PERF_TYPE_RAW, (fp_umask[i] << 8) | 0xC7, leader);
+    for (int i = 1; i < max_events; i++)
+      if (fds[i] >= 0) position[i] = nevents++;
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+};
+
+static thread_local thread_group counters;
+
+bool enable()
+{
+  use_fp_events    = is_intel();
+  counters_enabled = true;
+  counters.open();
+  if (counters.leader < 0)
+  {
+    counters_enabled = false;
+    return false;
+  }
+  return true;
+}
+
+bool available(int id)
+{
+  if (!counters_enabled) return false;
+  if (!counters.opened) counters.open();
+  if (id == perf_fp_ops)
+  {
+    for (int i = 0; i < num_fp_events; i++)
+      if (counters.position[3 + i] >= 0) return true;
+    return false;
+  }
+  return counters.position[id] >= 0;
+}
+
+void read(perf_count_t *values)
+{
+  for (int i = 0; i < num_perf_counters; i++)
+    values[i] = 0;
+  if (!counters_enabled) return;
+  if (!counters.opened) counters.open();
+  if (counters.leader < 0) return;
+
+  // nr, time_enabled, time_running, values[nr]
+  perf_count_t buf[3 + thread_group::max_events];
+  if (::read(counters.leader, buf, sizeof(buf)) < 0) return;
+  // scale if the group was multiplexed with other events
+  double scale = (buf[2] > 0 && buf[2] < buf[1]) ? double(buf[1]) / buf[2] : 1.0;
+  perf_count_t *v = buf + 3;
+  for (int i = 0; i < 3; i++)
+    if (counters.position[i] >= 0)
+      values[i] = perf_count_t(scale * v[counters.position[i]]);
+  double fp = 0.0;
+  for (int i = 0; i < num_fp_events; i++)
+    if (counters.position[3 + i] >= 0)
+      fp += fp_weight[i] * v[counters.position[3 + i]];
+  values[perf_fp_ops] = perf_count_t(scale * fp);
+}
+
+#else
+
+bool enable() { return false; }
+
+bool available(int id) { return false; }
+
+void read(perf_count_t *values)
+{
+  for (int i = 0; i < num_perf_counters; i++)
+    values[i] = 0;
+}
+
+#endif
+
+bool enabled() { return counters_enabled; }
+
+const char *name(int id)
+{
+  static const char *names[num_perf_counters] = {"cycles", "instructions",
+                                                 "llc_misses", "fp_ops"};
+  return (id >= 0 && id < num_perf_counters) ? names[id] : "";
+}
+
+}
+}
@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PerfCounters.h
+ * @brief Hardware performance counters read through perf_event_open (Linux)
+ *
+ * Each thread opens its own group of counters the first time it reads them,
+ * counting user-space events of that thread only. The counters are read with
+ * a single system call, so reading them around coarse regions is cheap but
+ * not free (~1 microsecond).
+ *
+ * FP operations are only counted on Intel processors (FP_ARITH_INST_RETIRED),
+ * as double precision flops: scalar + 2*128bit + 4*256bit + 8*512bit packed
+ * instructions. Counters that can not be opened (e.g. in virtual machines or
+ * with a restrictive /proc/sys/kernel/perf_event_paranoid) read 0 and are
+ * reported as unavailable.
+ */
+#ifndef QMCPLUSPLUS_PERF_COUNTERS_H
+#define QMCPLUSPLUS_PERF_COUNTERS_H
+
+namespace qmcplusplus
+{
+
+enum perf_counter_id
+{
+  perf_cycles,
+  perf_instructions,
+  perf_llc_misses,
+  perf_fp_ops,
+  num_perf_counters
+};
+
+typedef unsigned long long perf_count_t;
+
+namespace perf_counters
+{
+
+/** enables the counters, returns false if no counter can be opened
+ * Must be called before any thread reads the counters.
+ */
+bool enable();
+
+bool enabled();
+
+/// true if counter id could be opened by the calling thread
+bool available(int id);
+
+const char *name(int id);
+
+/// reads the counters of the calling thread into values[num_perf_counters]
+void read(perf_count_t *values);
+
+}
+}
+
+#endif
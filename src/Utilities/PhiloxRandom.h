@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PhiloxRandom.h
+ * @brief Counter-based random number generator (Philox4x32-10)
+ *
+ * Salmon, Moraes, Dror, Shaw, "Parallel random numbers: as easy as 1, 2, 3", SC11.
+ *
+ * The n-th block of 4 random 32-bit integers of a stream is a pure function of
+ * (key, counter), with key = seed and counter = (n, stream). Streams are
+ * independent, and moving to an arbitrary position of any stream is O(1).
+ * Bulk generation evaluates several blocks at once on independent lanes,
+ * so both the Philox rounds and the Box-Muller transform vectorize.
+ */
+#ifndef QMCPLUSPLUS_PHILOXRANDOM_H
+#define QMCPLUSPLUS_PHILOXRANDOM_H
+
+#include <stdint.h>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include "Message/OpenMP.h"
+
+template <typename T> struct PhiloxRandom
+{
+  /// real result type
+  typedef T result_type;
+  /// unsigned integer type
+  typedef uint32_t uint_type;
+  /// number of blocks evaluated together in bulk generation
+  static const int nlanes = 8;
+
+  /// number of contexts
+  int nContexts;
+  /// context number
+  int myContext;
+  /// offset of the random seed
+  int baseOffset;
+
+  PhiloxRandom() : nContexts(1), myContext(0), baseOffset(0)
+  {
+    init(omp_get_thread_num(), omp_get_num_threads(), -1);
+  }
+
+  explicit PhiloxRandom(uint_type iseed, uint64_t stream = 0)
+      : nContexts(1), myContext(0), baseOffset(0)
+  {
+    if (iseed == 0) iseed = MakeSeed(0, 1);
+    seed(iseed);
+    set_stream(stream);
+  }
+
+  /** initialize the stream: context i of nstr uses stream i */
+  inline void init(int i, int nstr, int iseed_in, uint_type offset = 1)
+  {
+    uint_type baseSeed = iseed_in;
+    myContext          = i;
+    nContexts          = nstr;
+    if (iseed_in <= 0) baseSeed = MakeSeed(i, nstr);
+    baseOffset = offset;
+    seed(baseSeed);
+    set_stream(i);
+  }
+
+  template <typename T1> inline void reset(const PhiloxRandom<T1> &rng)
+  {
+    key[0] = rng.key[0];
+    key[1] = rng.key[1];
+    set_stream(rng.stream());
+    set_counter(rng.counter());
+  }
+
+  /// get baseOffset
+  inline int offset() const { return baseOffset; }
+  /// assign baseOffset
+  inline int &offset() { return baseOffset; }
+
+  /// assign seed, the position in the current stream is not changed
+  inline void seed(uint_type aseed)
+  {
+    key[0] = aseed;
+    key[1] = 0x3c6ef372u;
+  }
+
+  inline uint_type get_seed() const { return key[0]; }
+
+  /// select stream s, and move to its beginning
+  inline void set_stream(uint64_t s)
+  {
+    strm = s;
+    set_counter(0);
+  }
+  inline uint64_t stream() const { return strm; }
+
+  /// move to block n of the current stream (each block holds 4 32-bit integers)
+  /// bulk generation always starts at a new block, values left in the buffer are discarded
+  inline void set_counter(uint64_t n)
+  {
+    ctr  = n;
+    navail = 0;
+  }
+  /// index of the next block to be generated
+  inline uint64_t counter() const { return ctr; }
+
+  /** return a random number [0,1)
+  */
+  inline result_type rand() { return to_real(*this); }
+  /** return a random number [0,1)
+  */
+  inline result_type operator()() { return to_real(*this); }
+
+  /** return a random integer
+  */
+  inline uint32_t irand()
+  {
+    if (navail == 0)
+    {
+      generate_blocks(buf);
+      navail = 4 * nlanes;
+    }
+    return buf[4 * nlanes - (navail--)];
+  }
+
+  /** generate a series of random numbers */
+  inline void generate_uniform(T *restrict d, int n)
+  {
+    const int per_block = 4 / words_per_real();
+    uint32_t r[4 * nlanes];
+    navail = 0;
+    for (int i = 0; i < n; i += nlanes * per_block)
+    {
+      generate_blocks(r);
+      int m = std::min(n - i, nlanes * per_block);
+      for (int k = 0; k < m; k++)
+        d[i + k] = to_real(r, k);
+    }
+  }
+
+  /** generate a series of normal random numbers with the Box-Muller transform */
+  inline void generate_normal(T *restrict d, int n) { box_muller(d, 1, n); }
+
+  /** only the real part is set, consistent with StdRandom */
+  inline void generate_normal(std::complex<T> *restrict d, int n)
+  {
+    T *restrict a = reinterpret_cast<T *>(d);
+    for (int i = 0; i < n; i++)
+      a[2 * i + 1] = T(0);
+    box_muller(a, 2, n);
+  }
+
+private:
+  uint32_t key[2];
+  uint64_t strm;
+  uint64_t ctr;
+  uint32_t buf[4 * nlanes];
+  int navail;
+
+  static constexpr int words_per_real() { return (sizeof(T) > 4) ? 2 : 1; }
+
+  static inline T to_real(PhiloxRandom &rng)
+  {
+    if (sizeof(T) > 4)
+    {
+      uint32_t a = rng.irand() >> 5, b = rng.irand() >> 6;
+      return T((a * 67108864.0 + b) * (1.0 / 9007199254740992.0));
+    }
+    return T((rng.irand() >> 8) * (1.0f / 16777216.0f));
+  }
+
+  // k-th real number in a buffer of random integers
+  static inline T to_real(const uint32_t *r, int k)
+  {
+    if (sizeof(T) > 4)
+      return T(((r[2 * k] >> 5) * 67108864.0 + (r[2 * k + 1] >> 6)) * (1.0 / 9007199254740992.0));
+    return T((r[k] >> 8) * (1.0f / 16777216.0f));
+  }
+
+  /// generates the next nlanes blocks of the stream into r
+  inline void generate_blocks(uint32_t *r)
+  {
+    philox_lanes(ctr, r);
+    ctr += nlanes;
+  }
+
+  /** Philox4x32-10 on blocks n0,...,n0+nlanes-1, the output of block l is r[4*l:4*l+4].
+   *  Data is kept in structure-of-arrays form, so the loops over lanes vectorize.
+   */
+  inline void philox_lanes(uint64_t n0, uint32_t *restrict r) const
+  {
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+    uint32_t c0[nlanes], c1[nlanes], c2[nlanes], c3[nlanes];
+    for (int l = 0; l < nlanes; l++)
+    {
+      uint64_t n = n0 + l;
+      c0[l]      = static_cast<uint32_t>(n);
+      c1[l]      = static_cast<uint32_t>(n >> 32);
+      c2[l]      = static_cast<uint32_t>(strm);
+      c3[l]      = static_cast<uint32_t>(strm >> 32);
+    }
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++)
+    {
+      for (int l = 0; l < nlanes; l++)
+      {
+        uint64_t p0 = uint64_t(M0) * c0[l];
+        uint64_t p1 = uint64_t(M1) * c2[l];
+        uint32_t t0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+        uint32_t t2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+        c1[l]       = static_cast<uint32_t>(p1);
+        c3[l]       = static_cast<uint32_t>(p0);
+        c0[l]       = t0;
+        c2[l]       = t2;
+      }
+      k0 += W0;
+      k1 += W1;
+    }
+    for (int l = 0; l < nlanes; l++)
+    {
+      r[4 * l]     = c0[l];
+      r[4 * l + 1] = c1[l];
+      r[4 * l + 2] = c2[l];
+      r[4 * l + 3] = c3[l];
+    }
+  }
+
+  /** normal random numbers into a[0], a[stride], ..., a[(n-1)*stride]
+   *  each pair of uniforms gives two normals, as in BoxMuller2.
+   *  Pairs are processed in chunks of npairs, with cos and sin terms in separate
+   *  arrays so the transform vectorizes.
+   */
+  inline void box_muller(T *restrict a, int stride, int n)
+  {
+    const int per_block = 4 / words_per_real();
+    const int ngroups   = 8;
+    const int npairs    = ngroups * nlanes * per_block / 2;
+    uint32_t r[4 * nlanes * ngroups];
+    T u1[npairs], u2[npairs], c[npairs], s[npairs];
+    navail = 0;
+    for (int i = 0; i < n; i += 2 * npairs)
+    {
+      int m = std::min(n - i, 2 * npairs);
+      // only the groups needed for the remaining m numbers are generated
+      int ng = (m + nlanes * per_block - 1) / (nlanes * per_block);
+      int np = ng * nlanes * per_block / 2;
+      for (int g = 0; g < ng; g++)
+        generate_blocks(r + 4 * nlanes * g);
+      for (int k = 0; k < np; k++)
+      {
+        u1[k] = T(1) - to_real(r, 2 * k);
+        u2[k] = to_real(r, 2 * k + 1);
+      }
+#pragma omp simd
+      for (int k = 0; k < np; k++)
+      {
+        T rad = std::sqrt(T(-2) * std::log(u1[k]));
+        c[k]  = rad * std::cos(T(6.283185307179586) * u2[k]);
+        s[k]  = rad * std::sin(T(6.283185307179586) * u2[k]);
+      }
+      for (int k = 0; k < m / 2; k++)
+      {
+        a[(i + 2 * k) * stride]     = c[k];
+        a[(i + 2 * k + 1) * stride] = s[k];
+      }
+      if (m % 2 == 1) a[(i + m - 1) * stride] = c[m / 2];
+    }
+  }
+
+  template <typename T1> friend struct PhiloxRandom;
+};
+#endif
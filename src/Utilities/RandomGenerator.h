@@ -23,6 +23,7 @@
  * @brief Declare a global Random Number Generator
  *
  * Selected among
+ * - Philox4x32-10 counter-based generator (default)
  * - C++11 std::random
  * - (other choices are in the QMCPACK distribution)
  *
@@ -118,10 +119,11 @@ inline uint32_t MakeSeed(int i, int n)
 }
 
 #include "Utilities/StdRandom.h"
+#include "Utilities/PhiloxRandom.h"
 namespace qmcplusplus
 {
-template <class T> using RandomGenerator = StdRandom<T>;
-typedef StdRandom<OHMMS_PRECISION_FULL> RandomGenerator_t;
+template <class T> using RandomGenerator = PhiloxRandom<T>;
+typedef PhiloxRandom<OHMMS_PRECISION_FULL> RandomGenerator_t;
 extern RandomGenerator_t Random;
 }
 
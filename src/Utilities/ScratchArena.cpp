@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file ScratchArena.cpp
+ * @brief Implements ScratchArena
+ */
+#include "Utilities/ScratchArena.h"
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <algorithm>
+
+namespace qmcplusplus
+{
+
+// arenas alive and peak usage of the ones already destroyed
+static std::mutex registry_lock;
+static std::vector<const ScratchArena*> registry;
+static std::size_t retired_peak = 0;
+static int retired_arenas       = 0;
+
+static const std::size_t min_chunk_size = 1 << 20;
+
+static std::size_t align_up(std::size_t n)
+{
+  return (n + ScratchArena::alignment - 1) / ScratchArena::alignment * ScratchArena::alignment;
+}
+
+ScratchArena::ScratchArena() : top(0), in_use(0), peak_(0)
+{
+  std::lock_guard<std::mutex> guard(registry_lock);
+  registry.push_back(this);
+}
+
+ScratchArena::~ScratchArena()
+{
+  free_chunks();
+  std::lock_guard<std::mutex> guard(registry_lock);
+  registry.erase(std::find(registry.begin(), registry.end(), this));
+  retired_peak += peak_;
+  retired_arenas++;
+}
+
+ScratchArena& ScratchArena::local()
+{
+  static thread_local ScratchArena arena;
+  return arena;
+}
+
+void ScratchArena::add_chunk(std::size_t bytes)
+{
+  void* p = nullptr;
+  if (posix_memalign(&p, alignment, bytes) != 0)
+    throw std::bad_alloc();
+  chunks.push_back(Chunk{static_cast<char*>(p), bytes, 0});
+}
+
+void ScratchArena::free_chunks()
+{
+  for (auto& c : chunks)
+    free(c.data);
+  chunks.clear();
+}
+
+ScratchArena::Mark ScratchArena::mark() const
+{
+  return Mark{top, top == 0 ? 0 : chunks[top - 1].used};
+}
+
+void* ScratchArena::allocate(std::size_t bytes)
+{
+  bytes = align_up(std::max(bytes, std::size_t(1)));
+  if (top == 0 || chunks[top - 1].used + bytes > chunks[top - 1].size)
+  {
+    // the rest of the current chunk is left unused, chunks after it are empty
+    top++;
+    if (top > chunks.size() || chunks[top - 1].size < bytes)
+    {
+      std::size_t last = chunks.empty() ? 0 : chunks.back().size;
+      for (std::size_t i = top - 1; i < chunks.size(); i++)
+        free(chunks[i].data);
+      chunks.resize(top - 1);
+      add_chunk(std::max(std::max(2 * last, min_chunk_size), bytes));
+    }
+  }
+  Chunk& c = chunks[top - 1];
+  void* p = c.data + c.used;
+  c.used += bytes;
+  in_use += bytes;
+  peak_ = std::max(peak_, in_use);
+  return p;
+}
+
+void ScratchArena::release(const Mark& m)
+{
+  for (std::size_t i = m.chunk; i < top; i++)
+    chunks[i].used = 0;
+  top = m.chunk;
+  if (top > 0)
+    chunks[top - 1].used = m.offset;
+  in_use = 0;
+  for (std::size_t i = 0; i < top; i++)
+    in_use += chunks[i].used;
+  // merge the chunks once the arena is empty
+  if (in_use == 0 && chunks.size() > 1)
+  {
+    free_chunks();
+    add_chunk(align_up(peak_));
+    top = 0;
+  }
+}
+
+std::size_t ScratchArena::used() const { return in_use; }
+
+std::size_t ScratchArena::capacity() const
+{
+  std::size_t n = 0;
+  for (auto& c : chunks)
+    n += c.size;
+  return n;
+}
+
+std::size_t ScratchArena::total_peak()
+{
+  std::lock_guard<std::mutex> guard(registry_lock);
+  std::size_t n = retired_peak;
+  for (auto a : registry)
+    n += a->peak();
+  return n;
+}
+
+int ScratchArena::num_arenas()
+{
+  std::lock_guard<std::mutex> guard(registry_lock);
+  return retired_arenas + registry.size();
+}
+
+}
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file ScratchArena.h
+ * @brief Per-thread stack allocator for the scratch space of the kernels
+ *
+ * Kernels request temporary arrays through a ScratchScope, which releases
+ * everything it allocated when it goes out of scope:
+ *
+ * \code
+ * ScratchScope scratch;   // arena of the calling thread
+ * auto T1 = scratch.matrix<ComplexType>(NAEA,NAEA);
+ * auto IWORK = scratch.vector<int>(NAEA);
+ * \endcode
+ *
+ * Scopes must be nested (LIFO) within a thread. Every thread has its own arena,
+ * so kernels can run concurrently, e.g. in OpenMP tasks or parallel regions.
+ * All blocks are aligned to ScratchArena::alignment bytes.
+ *
+ * The arena grows by adding chunks when a request does not fit. Once it is empty,
+ * the chunks are merged into a single one of the size of the peak usage, so after
+ * the first iteration of a loop no more heap allocations take place.
+ */
+#ifndef QMCPLUSPLUS_SCRATCH_ARENA_H
+#define QMCPLUSPLUS_SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/multi_array.hpp>
+
+namespace qmcplusplus
+{
+
+class ScratchArena
+{
+public:
+  static const std::size_t alignment = 64;
+
+  /// position in the arena, see mark and release
+  struct Mark
+  {
+    std::size_t chunk;
+    std::size_t offset;
+  };
+
+  ScratchArena();
+  ~ScratchArena();
+
+  /// arena of the calling thread
+  static ScratchArena& local();
+
+  void* allocate(std::size_t bytes);
+
+  Mark mark() const;
+
+  /// releases everything allocated after m
+  void release(const Mark& m);
+
+  /// bytes in use
+  std::size_t used() const;
+  /// largest number of bytes in use at any time
+  std::size_t peak() const { return peak_; }
+  std::size_t capacity() const;
+
+  /// sum of peak() over all the arenas, including those of finished threads
+  static std::size_t total_peak();
+  /// number of arenas, i.e. of threads that requested scratch space
+  static int num_arenas();
+
+private:
+  struct Chunk
+  {
+    char* data;
+    std::size_t size;
+    std::size_t used;
+  };
+
+  // chunks[0,top) are in use, chunks[top-1] holds the top of the stack
+  std::vector<Chunk> chunks;
+  std::size_t top;
+  std::size_t in_use;
+  std::size_t peak_;
+
+  void add_chunk(std::size_t bytes);
+  void free_chunks();
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+};
+
+/// work buffer with the interface used by the ma:: lapack wrappers
+template<class T>
+struct scratch_buffer
+{
+  T* ptr;
+  std::size_t n;
+  T* data() { return ptr; }
+  const T* data() const { return ptr; }
+  std::size_t size() const { return n; }
+  std::size_t capacity() const { return n; }
+};
+
+/** scoped allocation from a ScratchArena
+ */
+class ScratchScope
+{
+public:
+  explicit ScratchScope(ScratchArena& a = ScratchArena::local()) : arena(a), start(a.mark()) {}
+  ~ScratchScope() { arena.release(start); }
+
+  template<class T>
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(arena.allocate(n * sizeof(T)));
+  }
+
+  template<class T>
+  boost::multi_array_ref<T, 1> vector(std::size_t n)
+  {
+    return boost::multi_array_ref<T, 1>(allocate<T>(n), boost::extents[n]);
+  }
+
+  template<class T>
+  boost::multi_array_ref<T, 2> matrix(std::size_t n, std::size_t m)
+  {
+    return boost::multi_array_ref<T, 2>(allocate<T>(n * m), boost::extents[n][m]);
+  }
+
+  template<class T>
+  scratch_buffer<T> buffer(std::size_t n)
+  {
+    return scratch_buffer<T>{allocate<T>(n), n};
+  }
+
+private:
+  ScratchArena& arena;
+  ScratchArena::Mark start;
+
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+};
+
+}
+
+#endif
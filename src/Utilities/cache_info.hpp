@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file cache_info.hpp
+ *  @brief Data cache sizes of the machine, detected once at startup
+ */
+
+#ifndef AFQMC_CACHE_INFO_HPP
+#define AFQMC_CACHE_INFO_HPP
+
+#include<cstddef>
+#include<cstdlib>
+#include<string>
+#include<fstream>
+#include<unistd.h>
+
+namespace qmcplusplus {
+
+// size in bytes of the data (or unified) cache of the given level (1-3) seen by cpu0,
+// from sysfs if available, then sysconf. Returns a conservative default if both fail.
+inline std::size_t detect_cache_size(int level)
+{
+  for(int idx=0; idx<8; idx++) {
+    std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(idx) + "/";
+    std::ifstream flvl((dir+"level").c_str()), ftype((dir+"type").c_str()), fsize((dir+"size").c_str());
+    if(!flvl.good()) break;
+    int lvl = 0;
+    std::string type, size;
+    flvl >> lvl;
+    ftype >> type;
+    fsize >> size;
+    if(lvl != level || type == "Instruction" || size.empty()) continue;
+    std::size_t n = std::strtoul(size.c_str(),nullptr,10);
+    char unit = size.back();
+    if(unit == 'K') n <<= 10;
+    else if(unit == 'M') n <<= 20;
+    if(n > 0) return n;
+  }
+  long n = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+  if(level == 1) n = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+  else if(level == 2) n = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  else if(level == 3) n = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+  if(n > 0) return std::size_t(n);
+  return (level == 1)?(std::size_t(32)<<10):((level == 2)?(std::size_t(256)<<10):(std::size_t(8)<<20));
+}
+
+inline std::size_t l1_cache_size()
+{
+  static const std::size_t n = detect_cache_size(1);
+  return n;
+}
+
+inline std::size_t l2_cache_size()
+{
+  static const std::size_t n = detect_cache_size(2);
+  return n;
+}
+
+inline std::size_t l3_cache_size()
+{
+  static const std::size_t n = detect_cache_size(3);
+  return n;
+}
+
+}
+
+#endif
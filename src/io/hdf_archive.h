@@ -137,6 +137,38 @@ struct hdf_archive
     return e.read(p,aname,xfer_plist);
   }
 
+  /** read count elements of a 1D dataset, starting at offset and separated by stride,
+   * into the array first, which must be large enough
+   */
+  template<typename T> bool read_strided(T* first, const std::string& aname, hsize_t count, hsize_t offset=0, hsize_t stride=1)
+  {
+    if(Mode[NOIO])
+      return true;
+    hid_t p=group_id.empty()? file_id:group_id.top();
+    return h5d_read_strided(p,aname,count,offset,stride,first,xfer_plist);
+  }
+
+  /** create a 1D dataset of n elements stored in chunks of chunk elements,
+   * compressed if level>0. Data is written with write_strided.
+   */
+  template<typename T> bool create_chunked(const std::string& aname, hsize_t n, hsize_t chunk, int level=0)
+  {
+    if(Mode[NOIO])
+      return true;
+    hid_t p=group_id.empty()? file_id:group_id.top();
+    return h5d_create_chunked<T>(p,aname,n,chunk,level);
+  }
+
+  /** write count elements of first into a 1D dataset, starting at offset and separated by stride
+   */
+  template<typename T> bool write_strided(const T* first, const std::string& aname, hsize_t count, hsize_t offset=0, hsize_t stride=1)
+  {
+    if(Mode[NOIO])
+      return true;
+    hid_t p=group_id.empty()? file_id:group_id.top();
+    return h5d_write_strided(p,aname,count,offset,stride,first,xfer_plist);
+  }
+
   inline void unlink(const std::string& aname)
   {
     if(Mode[NOIO])
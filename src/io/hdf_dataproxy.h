@@ -16,6 +16,7 @@
 
 #include <io/hdf_datatype.h>
 #include <io/hdf_dataspace.h>
+#include <algorithm>
 
 namespace qmcplusplus
 {
@@ -115,6 +116,123 @@ bool h5d_read(hid_t grp, const std::string& aname, hsize_t ndims,
   return ret != -1;
 }
 
+/** read elements offset, offset+stride, ..., offset+(count-1)*stride of a 1D dataset
+ * into the contiguous array first, e.g. directly into the final storage of an object.
+ * Elements of compound types (e.g. complex) are handled as in h5_space_type.
+ * @return true if successful, false if the selection is outside the dataset
+ */
+template<typename T>
+bool h5d_read_strided(hid_t grp, const std::string& aname, hsize_t count, hsize_t offset,
+    hsize_t stride, T* first, hid_t xfer_plist)
+{
+  if(grp<0)
+    return true;
+  if(count==0)
+    return true;
+  hid_t h1 = H5Dopen(grp, aname.c_str());
+  if(h1<0)
+    return false;
+  h5_space_type<T,1> sp;
+  int rank=sp.size();
+  hid_t dataspace = H5Dget_space(h1);
+  hsize_t dims_in[2]={0,0};
+  if(H5Sget_simple_extent_ndims(dataspace) != rank ||
+     H5Sget_simple_extent_dims(dataspace,dims_in,NULL) < 0 ||
+     offset+(count-1)*stride >= dims_in[0])
+  {
+    H5Sclose(dataspace);
+    H5Dclose(h1);
+    return false;
+  }
+  hsize_t offsets[2]={offset,0};
+  hsize_t strides[2]={stride,1};
+  hsize_t counts[2]={count,(rank>1)?sp.dims[1]:1};
+  hid_t memspace = H5Screate_simple(rank, counts, NULL);
+  herr_t ret = H5Sselect_hyperslab(dataspace,H5S_SELECT_SET,offsets,strides,counts,NULL);
+  if(ret>=0)
+    ret = H5Dread(h1, get_h5_datatype(*first), memspace, dataspace, xfer_plist, first);
+  H5Sclose(dataspace);
+  H5Sclose(memspace);
+  H5Dclose(h1);
+  return ret >= 0;
+}
+
+/** create a 1D dataset of n elements of type T, stored in chunks of chunk elements.
+ * If level>0 and the deflate filter is available, chunks are compressed with
+ * the given compression level (1-9), after the shuffle filter.
+ * The data is written later with h5d_write_strided.
+ * @return true if successful
+ */
+template<typename T>
+bool h5d_create_chunked(hid_t grp, const std::string& aname, hsize_t n, hsize_t chunk, int level)
+{
+  if(grp<0)
+    return true;
+  T dummy=T();
+  h5_space_type<T,1> sp;
+  int rank=sp.size();
+  hsize_t dims[2]={n,(rank>1)?sp.dims[1]:1};
+  hsize_t chunk_dims[2]={std::max(hsize_t(1),std::min(chunk,n)),dims[1]};
+  hid_t p = H5Pcreate(H5P_DATASET_CREATE);
+  if(n>0)
+  {
+    H5Pset_chunk(p, rank, chunk_dims);
+    if(level>0 && H5Zfilter_avail(H5Z_FILTER_DEFLATE)>0)
+    {
+      H5Pset_shuffle(p);
+      H5Pset_deflate(p, static_cast<unsigned>(level));
+    }
+  }
+  hid_t dataspace = H5Screate_simple(rank, dims, NULL);
+  hid_t dataset = H5Dcreate2(grp, aname.c_str(), get_h5_datatype(dummy), dataspace, H5P_DEFAULT, p, H5P_DEFAULT);
+  H5Sclose(dataspace);
+  H5Pclose(p);
+  if(dataset<0)
+    return false;
+  H5Dclose(dataset);
+  return true;
+}
+
+/** write count elements of the contiguous array first into elements
+ * offset, offset+stride, ..., offset+(count-1)*stride of an existing 1D dataset.
+ * @return true if successful, false if the selection is outside the dataset
+ */
+template<typename T>
+bool h5d_write_strided(hid_t grp, const std::string& aname, hsize_t count, hsize_t offset,
+    hsize_t stride, const T* first, hid_t xfer_plist)
+{
+  if(grp<0)
+    return true;
+  if(count==0)
+    return true;
+  hid_t h1 = H5Dopen(grp, aname.c_str());
+  if(h1<0)
+    return false;
+  h5_space_type<T,1> sp;
+  int rank=sp.size();
+  hid_t dataspace = H5Dget_space(h1);
+  hsize_t dims_in[2]={0,0};
+  if(H5Sget_simple_extent_ndims(dataspace) != rank ||
+     H5Sget_simple_extent_dims(dataspace,dims_in,NULL) < 0 ||
+     offset+(count-1)*stride >= dims_in[0])
+  {
+    H5Sclose(dataspace);
+    H5Dclose(h1);
+    return false;
+  }
+  hsize_t offsets[2]={offset,0};
+  hsize_t strides[2]={stride,1};
+  hsize_t counts[2]={count,(rank>1)?sp.dims[1]:1};
+  hid_t memspace = H5Screate_simple(rank, counts, NULL);
+  herr_t ret = H5Sselect_hyperslab(dataspace,H5S_SELECT_SET,offsets,strides,counts,NULL);
+  if(ret>=0)
+    ret = H5Dwrite(h1, get_h5_datatype(*first), memspace, dataspace, xfer_plist, first);
+  H5Sclose(dataspace);
+  H5Sclose(memspace);
+  H5Dclose(h1);
+  return ret >= 0;
+}
+
 template<typename T>
 inline bool h5d_write(hid_t grp, const std::string& aname, hsize_t ndims, 
     const hsize_t* gcounts, const hsize_t* counts, const hsize_t* offsets,
@@ -28,21 +28,35 @@
  */
 // clang-format on
 #include <random>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+#include <memory>
+#include <fstream>
 
 #include <Configuration.h>
 #include <Utilities/PrimeNumberSet.h>
 #include <Utilities/NewTimer.h>
+#include <Utilities/PerfCounters.h>
 #include <Utilities/RandomGenerator.h>
+#include <Utilities/ScratchArena.h>
+#include <Utilities/NumaAllocator.h>
 #include <getopt.h>
 #include "io/hdf_archive.h"
 
+#include "Matrix/MatrixOperator.hpp"
+#include "Matrix/PlanarMatrix.hpp"
 #include "AFQMC/afqmc_sys.hpp"
 #include "Matrix/initialize_serial.hpp"
+#include "Matrix/initialize_synthetic.hpp"
 #include "AFQMC/rotate.hpp"
 #include "AFQMC/mixed_density_matrix.hpp"
 #include "AFQMC/energy.hpp"
 #include "AFQMC/vHS.hpp"
 #include "AFQMC/vbias.hpp"
+#include "AFQMC/force_bias.hpp"
+#include "AFQMC/checkpoint.hpp"
+#include "AFQMC/kernel_costs.hpp"
 
 using namespace std;
 using namespace qmcplusplus;
@@ -59,7 +73,11 @@ enum MiniQMCTimers
   Timer_extra,
   Timer_ovlp,
   Timer_ortho,
-  Timer_eloc
+  Timer_eloc,
+  Timer_pipeline,
+  Timer_checkpoint,
+  Timer_taskA,
+  Timer_taskB
 };
 
 TimerNameList_t<MiniQMCTimers> MiniQMCTimerNames = {
@@ -73,7 +91,11 @@ TimerNameList_t<MiniQMCTimers> MiniQMCTimerNames = {
     {Timer_extra, "Other"},
     {Timer_ovlp, "Overlap"},
     {Timer_ortho, "Orthgonalization"},
-    {Timer_eloc, "Local Energy"}
+    {Timer_eloc, "Local Energy"},
+    {Timer_pipeline, "Pipelined Propagation"},
+    {Timer_checkpoint, "Checkpoint"},
+    {Timer_taskA, "Pipeline Bias task"},
+    {Timer_taskB, "Pipeline Propagation task"}
 };
 
 void print_help()
@@ -85,11 +107,61 @@ void print_help()
   printf("-s                Number of substeps (default: 10)\n");
   printf("-w                Number of walkers (default: 16)\n");
   printf("-o                Number of substeps between orthogonalization (default: 10)\n");
+  printf("-a                Adaptive orthogonalization: a walker is orthogonalized when the ratio of the largest to the\n"
+         "                  smallest column norm of its determinants exceeds this value, or after -o substeps (default: 0, off)\n");
+  printf("-O                Orthogonalization method: lq, cholqr2 or mgs (default: lq)\n");
   printf("-f                Input file name (default: ./afqmc.h5)\n"); 
   printf("-t                If set to no, do not use half-rotated transposed Cholesky matrix to calculate bias potential (default yes).\n"); 
+  printf("-m                Storage format of Spvn,SpvnT,Vakbl: csr, sell, dense or auto. A single value applies to all (default: auto)\n");
+  printf("-c                Cap on the magnitude of the force bias, 0 for no cap (default: 0)\n");
+  printf("-p                Number of walker batches in pipelined mode, 1 disables the pipeline (default: 1)\n");
+  printf("-k                Checkpoint file, written in the background after every step (default: none)\n");
+  printf("-r                Restart from checkpoint file, -i steps are run after the restart (default: none)\n");
+  printf("-M                Prefix of memory-mapped CSR files for Spvn,SpvnT,Vakbl. Created from the hdf5 file if missing,\n"
+         "                  otherwise the 2-body terms are not read from the hdf5 file. Overrides -m (default: none)\n");
+  printf("-g                Generate a synthetic hamiltonian instead of reading -f: NMO,NAEA,nchol[,density[,seed]]\n"
+         "                  density is the fraction of non-zero elements in the Cholesky vectors (default: none)\n");
+  printf("-P                Read Spvn in this number of partitions, as in the distributed loading mode (default: 1)\n");
+  printf("-j                Write the timer profiles to this file, in csv format if the name ends in .csv, json otherwise (default: none)\n");
+  printf("-H                Read hardware counters (perf_event) in timers up to this level: coarse, medium or fine (default: none)\n");
+  printf("-A                Memory policy of the hamiltonian and walker arrays: huge pages (none, thp or huge) and\n"
+         "                  NUMA placement (default, first_touch or interleave), comma separated (default: none,default)\n");
+  printf("-R                Number of copies of Spvn and SpvnT, on different NUMA nodes. Products are then threaded over walkers\n"
+         "                  and every thread uses the copy of its node. 0 for one per node (default: 1)\n");
+  printf("-T                Number of walkers per tile in the sparse products, 0 for automatic (from the L2 size),\n"
+         "                  -1 for no tiling (default: 0)\n");
+  printf("-F                Kernels specialized for NAEA <= %d and NMO <= %d in the density matrix, overlap and propagation:\n"
+         "                  yes, no (generic BLAS/LAPACK kernels) or auto (the faster of the two for each kernel) (default: auto)\n",
+         base::fixed_max_nel,base::fixed_max_nmo);
+  printf("-S                Stream vHS: calculate it for blocks of this number of walkers during the propagation, in per-thread\n"
+         "                  buffers, instead of storing it for all walkers. 0 for automatic (from the L2 size), -1 for no streaming.\n"
+         "                  Not available with -z (default: -1)\n");
+  printf("-z                Keep the density matrix, bias potential, X and vHS in planar storage (real and imaginary\n"
+         "                  parts in separate arrays) in the sparse products. Not available with -p (default: no)\n");
+  printf("-b                Benchmark the products with every storage format before starting\n");
   printf("-v                Verbose output\n");
 }
 
+// times op(A)*B for every storage format, keeping the CSR matrix.
+// As in select_storage, dense storage is skipped below default_min_dense_fill.
+void benchmark_storage(const std::string& name, MatrixOperator<ComplexType>& A, char op, int nrhs)
+{
+  for(auto f: {storage_csr, storage_sell, storage_dense}) {
+    A.set_storage(storage_csr,true);
+    if(f == storage_dense && A.density() < default_min_dense_fill) {
+      std::cout<<"    " <<std::setw(6) <<name <<"  " <<op <<"  " <<std::setw(5) <<storage_name(f)
+               <<"  skipped, density: " <<A.density() <<"\n";
+      continue;
+    }
+    A.set_storage(f,true);
+    double t = time_product(A,op,nrhs);
+    std::cout<<"    " <<std::setw(6) <<name <<"  " <<op <<"  " <<std::setw(5) <<storage_name(f)
+             <<"  time: " <<std::setw(12) <<t
+             <<"  memory (MB): " <<std::setw(10) <<A.memory_usage()/1024.0/1024.0
+             <<"  fill: " <<A.fill_efficiency() <<"\n";
+  }
+}
+
 int main(int argc, char **argv)
 {
 
@@ -102,6 +174,8 @@ int main(int argc, char **argv)
   int nsubsteps=10; 
   int nwalk=16;
   int northo = 10;
+  base::ortho_method ortho = base::ortho_lq;
+  RealType ortho_threshold = 0.0;
   const double dt = 0.01;  // 1-body propagators are assumed to be generated with a timestep = 0.01
 
   bool verbose = false;
@@ -109,6 +183,23 @@ int main(int argc, char **argv)
   std::string init_file = "afqmc.h5";
 
   bool transposed_Spvn = true;
+  bool benchmark = false;
+  int nbatch = 1;
+  int nparts = 1;
+  int nreplicas = 1;
+  int walker_tile = 0;
+  bool planar = false;
+  int stream_block = -1;
+  std::string fixed_size = "auto";
+  double vbias_cap = 0.0;
+  std::string checkpoint_file;
+  std::string restart_file;
+  std::string mmap_prefix;
+  std::string timer_file;
+  timer_levels counter_level = timer_level_none;
+  afqmc::synthetic_hamiltonian synthetic;
+  // storage format of Spvn, SpvnT and Vakbl
+  std::vector<matrix_storage> storage(3,storage_auto);
 
   ComplexType one(1.),zero(0.),half(0.5);
   ComplexType cone(1.),czero(0.);
@@ -117,7 +208,7 @@ int main(int argc, char **argv)
 
   char *g_opt_arg;
   int opt;
-  while ((opt = getopt(argc, argv, "thvi:s:w:o:f:")) != -1)
+  while ((opt = getopt(argc, argv, "t:F:S:hvbzi:s:w:o:O:a:f:m:p:c:k:r:M:P:j:H:g:A:R:T:")) != -1)
   {
     switch (opt)
     {
@@ -134,12 +225,108 @@ int main(int argc, char **argv)
     case 'o': // the number of sub steps for drift/diffusion
       northo = atoi(optarg);
       break;
+    case 'a':
+      ortho_threshold = atof(optarg);
+      break;
+    case 'O':
+      if(!base::parse_ortho(std::string(optarg),ortho)) {
+        std::cerr<<" Error: Unknown orthogonalization method: " <<optarg <<std::endl;
+        exit(1);
+      }
+      break;
     case 't':
       transposed_Spvn = (std::string(optarg) != "no");
       break;
     case 'f':
       init_file = std::string(optarg);
       break;    
+    case 'm':
+      {
+        std::vector<std::string> fmts;
+        std::stringstream ss(optarg);
+        std::string fs;
+        while(std::getline(ss,fs,',')) fmts.push_back(fs);
+        if(fmts.size() == 1) fmts.resize(3,fmts[0]);
+        if(fmts.size() != 3) {
+          std::cerr<<" Error: -m expects 1 or 3 storage formats. \n";
+          exit(1);
+        }
+        for(int i=0; i<3; i++)
+          if(!parse_storage(fmts[i],storage[i])) {
+            std::cerr<<" Error: Unknown storage format: " <<fmts[i] <<std::endl;
+            exit(1);
+          }
+      }
+      break;
+    case 'p':
+      nbatch = atoi(optarg);
+      break;
+    case 'c':
+      vbias_cap = atof(optarg);
+      break;
+    case 'k':
+      checkpoint_file = std::string(optarg);
+      break;
+    case 'r':
+      restart_file = std::string(optarg);
+      break;
+    case 'M':
+      mmap_prefix = std::string(optarg);
+      break;
+    case 'P':
+      nparts = atoi(optarg);
+      break;
+    case 'j':
+      timer_file = std::string(optarg);
+      break;
+    case 'g':
+      if(!afqmc::parse_synthetic_hamiltonian(std::string(optarg),synthetic)) {
+        std::cerr<<" Error: Invalid synthetic hamiltonian parameters: " <<optarg <<std::endl;
+        exit(1);
+      }
+      break;
+    case 'H':
+      {
+        std::string lvl(optarg);
+        if(lvl == "coarse") counter_level = timer_level_coarse;
+        else if(lvl == "medium") counter_level = timer_level_medium;
+        else if(lvl == "fine") counter_level = timer_level_fine;
+        else if(lvl != "none") {
+          std::cerr<<" Error: Unknown timer level: " <<lvl <<std::endl;
+          exit(1);
+        }
+      }
+      break;
+    case 'A':
+      {
+        memory_policy mp;
+        if(!parse_memory_policy(std::string(optarg),mp)) {
+          std::cerr<<" Error: Unknown memory policy: " <<optarg <<std::endl;
+          exit(1);
+        }
+        set_memory_policy(mp);
+      }
+      break;
+    case 'R':
+      nreplicas = atoi(optarg);
+      break;
+    case 'T':
+      walker_tile = atoi(optarg);
+      break;
+    case 'F':
+      fixed_size = std::string(optarg);
+      if(fixed_size != "yes" && fixed_size != "no" && fixed_size != "auto") {
+        std::cerr<<" Error: -F expects yes, no or auto. \n";
+        exit(1);
+      }
+      break;
+    case 'S':
+      stream_block = atoi(optarg);
+      break;
+    case 'z': planar = true;
+      break;
+    case 'b': benchmark = true;
+      break;
     case 'v': verbose  = true; 
       break;
     }
@@ -148,41 +335,152 @@ int main(int argc, char **argv)
   Random.init(0, 1, iseed);
   int ip = 0;
   PrimeNumberSet<uint32_t> myPrimes;
-  // create generator within the thread
+  // counter-based generator, walker w uses stream walker_offset+w positioned by the substep index,
+  // so trajectories do not depend on the number of threads or batches.
+  // walker_offset is the global index of the first walker owned by this process.
   RandomGenerator<RealType> random_th(myPrimes[ip]);
+  const int walker_offset = 0;
 
   TimerManager.set_timer_threshold(timer_level_coarse);
   TimerList_t Timers;
   setup_timers(Timers, MiniQMCTimerNames, timer_level_coarse);
+  if(counter_level != timer_level_none) {
+    if(perf_counters::enable())
+      TimerManager.set_counter_threshold(counter_level);
+    else
+      std::cerr<<" Warning: Hardware counters are not available, check /proc/sys/kernel/perf_event_paranoid. " <<std::endl;
+  }
 
   // Important Data Structures
   base::afqmc_sys AFQMCSys;   // Main AFQMC object. Control access to several apgorithmic functions. 
-  ComplexSpMat Spvn;      // (Symmetric) Factorized Hamiltonian, e.g. <ij|kl> = sum_n Spvn(ik,n) * Spvn(jl,n)
-  ComplexSpMat SpvnT;   // Transposed half-transformed Factorized Hamiltonian, SpvnT(n,ak) = sum_i conj(Wfn(a,i)) * Spvn(ik,n) 
+  MatrixOperator<ComplexType> Spvn;      // (Symmetric) Factorized Hamiltonian, e.g. <ij|kl> = sum_n Spvn(ik,n) * Spvn(jl,n)
+  MatrixOperator<ComplexType> SpvnT;   // Transposed half-transformed Factorized Hamiltonian, SpvnT(n,ak) = sum_i conj(Wfn(a,i)) * Spvn(ik,n) 
   ComplexMatrix haj;    // 1-Body Hamiltonian Matrix
-  ComplexSpMat Vakbl;   // 2-Body Hamiltonian Matrix: (Half-Rotated) 2-electron integrals 
+  MatrixOperator<ComplexType> Vakbl;   // 2-Body Hamiltonian Matrix: (Half-Rotated) 2-electron integrals 
   ComplexMatrix Propg1;   // propagator for 1-body hamiltonian 
 
 //  index_gen indices;
 
+  bool generate = synthetic.NMO > 0;
+  if(planar && nbatch > 1) {
+    std::cerr<<" Error: -z can not be used in pipelined mode (-p). " <<std::endl;
+    exit(1);
+  }
+  bool streamed = stream_block >= 0;
+  if(planar && streamed) {
+    std::cerr<<" Error: -z can not be used with streamed vHS (-S). " <<std::endl;
+    exit(1);
+  }
+  if(generate && (!mmap_prefix.empty() || nparts > 1)) {
+    std::cerr<<" Error: -M and -P can not be used with a synthetic hamiltonian. " <<std::endl;
+    exit(1);
+  }
+
   hdf_archive dump;
-  if(!dump.open(init_file,H5F_ACC_RDONLY)) 
+  if(!generate && !dump.open(init_file,H5F_ACC_RDONLY)) 
     APP_ABORT("Error: problems opening hdf5 file. \n");
 
   std::cout<<"***********************************************************\n";
+  if(generate)
+  std::cout<<"            Initializing synthetic hamiltonian             \n"; 
+  else
   std::cout<<"                 Initializing from HDF5                    \n"; 
   std::cout<<"***********************************************************\n";
 
-  if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+  // memory-mapped CSR files, shared by all processes on a node.
+  // If they exist, the 2-body terms are not read from the hdf5 file.
+  std::string Spvn_file = mmap_prefix + "_Spvn.csr";
+  std::string SpvnT_file = mmap_prefix + "_SpvnT.csr";
+  std::string Vakbl_file = mmap_prefix + "_Vakbl.csr";
+  bool mapped = false;
+  if(!mmap_prefix.empty()) {
+    auto exists = [](const std::string& f) { return std::ifstream(f.c_str()).good(); };
+    mapped = exists(Spvn_file) && exists(Vakbl_file) && (!transposed_Spvn || exists(SpvnT_file));
+  }
+
+  if(generate)
+    afqmc::Initialize_synthetic(synthetic,dt,AFQMCSys,Propg1,Spvn.csr(),haj,Vakbl.csr());
+  else if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn.csr(),haj,Vakbl.csr(),!mapped,nparts)) {
     std::cerr<<" Error initalizing data structures from hdf5 file: " <<init_file <<std::endl;
     exit(1);
   }
 
-  if(transposed_Spvn) base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,
-                                                 AFQMCSys.trialwfn_beta,   
-                                                 Spvn,
-                                                 SpvnT   
-                                                );
+  // the half-rotated Cholesky matrix is calculated, unless it was stored in the hdf5 file
+  if(transposed_Spvn && !mapped && (generate || !afqmc::read_SpvnT(dump,dt,SpvnT.csr())))
+    base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,
+                              AFQMCSys.trialwfn_beta,   
+                              Spvn.csr(),
+                              SpvnT.csr()
+                             );
+
+  // hdf5 is not thread safe, the input file is closed before checkpoints are written in the background
+  dump.close();
+
+  if(!mmap_prefix.empty()) {
+    if(!mapped) {
+      std::cout<<"  Writing CSR files: " <<mmap_prefix <<"_*.csr \n";
+      if(!Spvn.write_csr(Spvn_file) || !Vakbl.write_csr(Vakbl_file) ||
+         (transposed_Spvn && !SpvnT.write_csr(SpvnT_file))) {
+        std::cerr<<" Error writing CSR files. " <<std::endl;
+        exit(1);
+      }
+    }
+    if(!Spvn.map_csr(Spvn_file) || !Vakbl.map_csr(Vakbl_file) ||
+       (transposed_Spvn && !SpvnT.map_csr(SpvnT_file))) {
+      std::cerr<<" Error mapping CSR files. " <<std::endl;
+      exit(1);
+    }
+    int NMO = AFQMCSys.NMO, NAEA = AFQMCSys.NAEA;
+    if(Spvn.rows() != NMO*NMO || Vakbl.rows() != 2*NMO*NAEA || Vakbl.cols() != 2*NMO*NAEA ||
+       (transposed_Spvn && (SpvnT.rows() != Spvn.cols() || SpvnT.cols() != 2*NMO*NAEA))) {
+      std::cerr<<" Error: Dimensions of CSR files are inconsistent with " <<init_file <<std::endl;
+      exit(1);
+    }
+    // formats other than CSR require the matrix in memory
+    benchmark = false;
+    std::fill(storage.begin(),storage.end(),storage_mapped);
+  }
+
+  if(benchmark) {
+    std::cout<<"\n";
+    std::cout<<"***********************************************************\n";
+    std::cout<<"                 Storage Format Benchmark                  \n";
+    std::cout<<"***********************************************************\n";
+    if(transposed_Spvn)
+      benchmark_storage("SpvnT",SpvnT,'N',nwalk);
+    else
+      benchmark_storage("Spvn",Spvn,'T',nwalk);
+    benchmark_storage("Spvn",Spvn,'N',nwalk);
+    benchmark_storage("Vakbl",Vakbl,'N',nwalk);
+  }
+
+  // auto: pick the fastest format for the products used in the propagation
+  if(storage[0] == storage_mapped) {}
+  else if(storage[0] == storage_auto) select_storage(Spvn,(transposed_Spvn?"N":"NT"),nwalk);
+  else Spvn.set_storage(storage[0]);
+  if(transposed_Spvn && storage[1] != storage_mapped) {
+    if(storage[1] == storage_auto) select_storage(SpvnT,"N",nwalk);
+    else SpvnT.set_storage(storage[1]);
+  }
+  if(storage[2] == storage_mapped) {}
+  else if(storage[2] == storage_auto) select_storage(Vakbl,"N",nwalk);
+  else Vakbl.set_storage(storage[2]);
+
+  Spvn.set_walker_tile(walker_tile);
+  SpvnT.set_walker_tile(walker_tile);
+  Vakbl.set_walker_tile(walker_tile);
+
+  // per-node copies of the operators used in get_vbias and get_vHS
+  nreplicas = Spvn.set_replicas(nreplicas);
+  if(transposed_Spvn) SpvnT.set_replicas(nreplicas);
+
+  if(fixed_size == "auto")
+    AFQMCSys.select_fixed_size_kernels();
+  else
+    AFQMCSys.use_fixed_size_kernels(fixed_size == "yes");
+
+  // walkers per block of streamed vHS, for a batch of n walkers
+  auto vHS_block = [&](int n) { return (stream_block > 0)?stream_block:AFQMCSys.streamed_block_size(n); };
 
   RealType Eshift = 0;
   int NMO = AFQMCSys.NMO;              // number of molecular orbitals
@@ -204,21 +502,78 @@ int main(int argc, char **argv)
            <<"    nsubsteps: " <<nsubsteps <<"\n" 
            <<"    nwalk: " <<nwalk <<"\n"
            <<"    northo: " <<northo <<"\n"
+           <<"    ortho: " <<base::ortho_name(ortho) <<"\n"
+           <<"    adaptive ortho threshold: " <<ortho_threshold <<"\n"
+           <<"    walker batches: " <<nbatch <<"\n"
+           <<"    planar storage: " <<std::boolalpha <<planar <<"\n"
+           <<"    streamed vHS block: " <<(streamed?std::to_string(vHS_block(nwalk)):std::string("none")) <<"\n"
+           <<"    fixed-size kernels: " <<AFQMCSys.fixed_size_kernels_name() <<"\n"
+           <<"    force bias cap: " <<vbias_cap <<"\n"
+           <<"    checkpoint file: " <<(checkpoint_file.empty()?std::string("none"):checkpoint_file) <<"\n"
+           <<"    restart file: " <<(restart_file.empty()?std::string("none"):restart_file) <<"\n"
+           <<"    memory policy: " <<memory_policy_name(get_memory_policy()) <<" (" <<numa_num_nodes() <<" NUMA nodes)\n"
            <<"    verbose: " <<std::boolalpha <<verbose <<"\n"
            <<"    # Chol Vectors: " <<nchol <<"\n"
            <<"    transposed Spvn: " <<transposed_Spvn <<"\n"
            <<"    Chol. Matrix Sparsity: " <<Spvn.size()/double(nchol*NMO*NMO) <<"\n"
-           <<"    Hamiltonian Sparsity: " <<Vakbl.size()/double(NAEA*NAEA*NMO*NMO*4.0) <<std::endl;
-
-  ComplexMatrix vbias(extents[nchol][nwalk]);     // bias potential
-  ComplexMatrix vHS(extents[NMO*NMO][nwalk]);        // Hubbard-Stratonovich potential
-  ComplexMatrix G(extents[NIK][nwalk]);           // density matrix
+           <<"    Hamiltonian Sparsity: " <<Vakbl.size()/double(NAEA*NAEA*NMO*NMO*4.0) <<"\n"
+           <<"    Spvn storage: " <<storage_name(Spvn.storage()) <<" (fill: " <<Spvn.fill_efficiency() <<")\n";
+  if(transposed_Spvn)
+    std::cout<<"    SpvnT storage: " <<storage_name(SpvnT.storage()) <<" (fill: " <<SpvnT.fill_efficiency() <<")\n";
+  std::cout<<"    Vakbl storage: " <<storage_name(Vakbl.storage()) <<" (fill: " <<Vakbl.fill_efficiency() <<")\n";
+  std::cout<<"    walker tile (Spvn,SpvnT,Vakbl): " <<Spvn.walker_tile(nwalk) <<","
+           <<(transposed_Spvn?SpvnT.walker_tile(nwalk):0) <<"," <<Vakbl.walker_tile(nwalk) <<"\n";
+  std::cout<<"    Spvn/SpvnT copies: " <<nreplicas <<" (MB per copy: "
+           <<(Spvn.memory_usage()+(transposed_Spvn?SpvnT.memory_usage():0))/1024.0/1024.0 <<")" <<std::endl;
+
+  // pipelined mode: batch b holds walkers [wbatch[b],wbatch[b+1]), with separate buffers per batch
+  nbatch = std::max(1,std::min(nbatch,nwalk));
+  std::vector<int> wbatch(nbatch+1);
+  for(int b=0; b<=nbatch; b++) wbatch[b] = b*nwalk/nbatch;
+
+  // the full-size G, vbias, X and vHS are only used without batches
+  int nwfull = (nbatch > 1)?0:nwalk;
+  ComplexMatrix vbias(extents[nchol][nwfull]);     // bias potential
+  ComplexMatrix vHS(extents[streamed?0:NMO*NMO][nwfull]);        // Hubbard-Stratonovich potential, not stored if streamed
+  ComplexMatrix G(extents[NIK][nwfull]);           // density matrix
   ComplexMatrix Gc(extents[NAK][nwalk]);           // compact density matrix for energy evaluation
-  ComplexMatrix X(extents[nchol][nwalk]);         // X(n,nw) = rand(n,nw) ( + vbias(n,nw)) 
+  ComplexMatrix X(extents[nchol][nwfull]);         // X(n,nw) = rand(n,nw) ( + vbias(n,nw)) 
+
+  // planar mode: density matrix (G or Gc), vbias, X and vHS in split real/imaginary storage
+  PlanarMatrix<RealType> Gp, vbias_p, X_p, vHS_p;
+  if(planar) {
+    Gp.resize(transposed_Spvn?NAK:NIK,nwalk);
+    vbias_p.resize(nchol,nwalk);
+    X_p.resize(nchol,nwalk);
+    vHS_p.resize(NMO*NMO,nwalk);
+  }
 
+  std::vector<ComplexMatrix> Gb, vbias_b, Xb, vHSb;
+  if(nbatch > 1) {
+    for(int b=0; b<nbatch; b++) {
+      int nb = wbatch[b+1]-wbatch[b];
+      Gb.emplace_back(extents[transposed_Spvn?NAK:NIK][nb]);
+      vbias_b.emplace_back(extents[nchol][nb]);
+      Xb.emplace_back(extents[nchol][nb]);
+      vHSb.emplace_back(extents[streamed?0:NMO*NMO][nb]);
+    }
+  }
+  // task dependences: dm_done[b] is set by A(b) and cleared by B(b), dm_done[nbatch] and
+  // dm_done[nbatch+1] serialize the A and B tasks respectively
+  std::vector<char> dm_ready(nbatch+2);
+  char* dm_done = dm_ready.data();
   ComplexVector hybridW(extents[nwalk]);         // stores weight factors
   ComplexVector eloc(extents[nwalk]);         // stores local energies
 
+  // adaptive orthogonalization: conditioning estimate from propagate and substeps since
+  // the last orthogonalization of each walker
+  bool adaptive_ortho = ortho_threshold > 0.0;
+  std::vector<RealType> ortho_cond(nwalk,1.0);
+  std::vector<int> since_ortho(nwalk,0), ortho_list;
+  ortho_list.reserve(nwalk);
+  long northo_walkers = 0, nwalk_substeps = 0;
+  RealType* cond = adaptive_ortho?ortho_cond.data():nullptr;
+
   WalkerContainer W(extents[nwalk][2][NMO][NAEA]);
   // 0: eloc, 1: weight, 2: ovlp_up, 3: ovlp_down, 4: w_eloc, 5: old_w_eloc, 6: old_ovlp_alpha, 7: old_ovlp_beta
   ComplexMatrix W_data(extents[nwalk][8]);  
@@ -238,6 +593,44 @@ int main(int argc, char **argv)
   // initialize overlaps and energy
   AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
   RealType Eav = AFQMCSys.calculate_energy(W_data,Gc,haj,Vakbl);
+
+  // resume from a checkpoint, the trajectory continues exactly as in an uninterrupted run
+  int step0 = 0, step_tot0 = 0;
+  if(!restart_file.empty()) {
+    afqmc::WalkerCheckpoint chk;
+    if(!afqmc::read_checkpoint(restart_file,chk) || !chk.get(W,W_data,since_ortho,ortho_cond)) {
+      std::cerr<<" Error restarting from checkpoint file: " <<restart_file <<std::endl;
+      exit(1);
+    }
+    if(!chk.same_options(nsubsteps,northo,dt,static_cast<int>(ortho),vbias_cap,ortho_threshold)) {
+      std::cerr<<" Error: Checkpoint was written with different options. " <<std::endl;
+      exit(1);
+    }
+    if(chk.walker_offset != walker_offset) {
+      std::cerr<<" Error: Checkpoint was written with a different walker offset. " <<std::endl;
+      exit(1);
+    }
+    step0 = chk.step;
+    step_tot0 = chk.step_tot;
+    Eshift = chk.Eshift;
+    random_th.seed(chk.seed);
+    std::cout<<"\n  Restarting from " <<restart_file <<" after step " <<step0 <<"\n";
+  }
+  std::unique_ptr<afqmc::CheckpointWriter> checkpoint;
+  if(!checkpoint_file.empty())
+    checkpoint.reset(new afqmc::CheckpointWriter(checkpoint_file,nsubsteps,northo,dt,static_cast<int>(ortho),
+                                                 vbias_cap,ortho_threshold));
+
+  // analytic work of each kernel call, reported with the timers
+  base::kernel_cost cost_DMc = base::mixed_density_matrix_cost(NMO,NAEA,nwalk,true);
+  base::kernel_cost cost_DM = base::mixed_density_matrix_cost(NMO,NAEA,nwalk,false);
+  base::kernel_cost cost_vbias = transposed_Spvn?base::vbias_cost(SpvnT,nwalk,true):base::vbias_cost(Spvn,nwalk,false);
+  base::kernel_cost cost_vHS = base::vHS_cost(Spvn,nwalk);
+  base::kernel_cost cost_Propg = base::propagate_cost(NMO,NAEA,nwalk);
+  base::kernel_cost cost_ovlp = base::overlap_cost(NMO,NAEA,nwalk);
+  base::kernel_cost cost_ortho = base::orthogonalize_cost(NMO,NAEA,nwalk,ortho);
+  base::kernel_cost cost_eloc = cost_DMc + base::energy_cost(Vakbl,nwalk);
+  auto add_work = [&](MiniQMCTimers t, const base::kernel_cost& c) { Timers[t]->add_work(c.flops,c.bytes); };
   
   std::cout<<"\n";
   std::cout<<"***********************************************************\n";
@@ -246,71 +639,168 @@ int main(int argc, char **argv)
   std::cout<<"# Step   Energy   \n";
 
   Timers[Timer_Total]->start();
-  for(int step = 0, step_tot=0; step < nsteps; step++) {
+  for(int step = step0, step_tot=step_tot0; step < step0+nsteps; step++) {
   
     for(int substep = 0; substep < nsubsteps; substep++, step_tot++) {
 
       // propagate walker forward 
-      
-      // 1. calculate density matrix and bias potential 
-      
-      if(transposed_Spvn) {
-
-        Timers[Timer_DMc]->start();
-        AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
-        Timers[Timer_DMc]->stop();
-
-        Timers[Timer_vbias]->start();
-        base::get_vbias(SpvnT,Gc,vbias,true);  
-        Timers[Timer_vbias]->stop();
-  
-      } else {
 
-        Timers[Timer_DM]->start();
-        AFQMCSys.calculate_mixed_density_matrix(W,W_data,G,false); 
-        Timers[Timer_DM]->stop();
-
-        Timers[Timer_vbias]->start();
-        base::get_vbias(Spvn,G,vbias,false);
-        Timers[Timer_vbias]->stop();
-
-      } 
-
-      // 2. calculate X and weight
-      //  X(chol,nw) = rand + i*vbias(chol,nw)
-      Timers[Timer_X]->start();
-      random_th.generate_normal(X.data(),X.num_elements()); 
-      std::fill(hybridW.begin(),hybridW.end(),ComplexType(0.)); 
-      for(int n=0; n<nchol; n++)
-        for(int nw=0; nw<nwalk; nw++) { 
-          hybridW[nw] -= im*vbias[n][nw]*(X[n][nw]+halfim*vbias[n][nw]);
-          X[n][nw] += im*vbias[n][nw];
+      if(nbatch > 1) {
+
+        // Steps 1-5 below on walker batches:
+        //   task A(b): density matrix and bias potential of batch b
+        //   task B(b): X, vHS, propagation and overlaps of batch b
+        // A(b+1) runs concurrently with B(b). Tasks of the same kind are serialized,
+        // the kernels take their scratch space from the arena of the thread running the task.
+        Timers[Timer_pipeline]->start();
+        #pragma omp parallel
+        {
+          #pragma omp single
+          {
+            for(int b=0; b<nbatch; b++) {
+
+              #pragma omp task depend(inout: dm_done[nbatch]) depend(out: dm_done[b])
+              {
+                Timers[Timer_taskA]->thread_start();
+                int w0 = wbatch[b], nb = wbatch[b+1]-wbatch[b];
+                boost::multi_array_ref<ComplexType,4> Wb(W.data()+w0*2*NMO*NAEA, extents[nb][2][NMO][NAEA]);
+                boost::multi_array_ref<ComplexType,2> Wdb(W_data.data()+w0*8, extents[nb][8]);
+                AFQMCSys.calculate_mixed_density_matrix(Wb,Wdb,Gb[b],transposed_Spvn);
+                if(transposed_Spvn)
+                  base::get_vbias(SpvnT,Gb[b],vbias_b[b],true);
+                else
+                  base::get_vbias(Spvn,Gb[b],vbias_b[b],false);
+                Timers[Timer_taskA]->thread_stop();
+                add_work(Timer_taskA, base::mixed_density_matrix_cost(NMO,NAEA,nb,transposed_Spvn) +
+                                      (transposed_Spvn?base::vbias_cost(SpvnT,nb,true):base::vbias_cost(Spvn,nb,false)));
+                dm_done[b] = 1;
+              }
+
+              #pragma omp task depend(inout: dm_done[nbatch+1]) depend(in: dm_done[b])
+              {
+                Timers[Timer_taskB]->thread_start();
+                assert(dm_done[b]);
+                dm_done[b] = 0;
+                int w0 = wbatch[b], nb = wbatch[b+1]-wbatch[b];
+                boost::multi_array_ref<ComplexType,4> Wb(W.data()+w0*2*NMO*NAEA, extents[nb][2][NMO][NAEA]);
+                boost::multi_array_ref<ComplexType,2> Wdb(W_data.data()+w0*8, extents[nb][8]);
+                base::sample_auxiliary_fields(random_th,walker_offset+w0,step_tot,vbias_b[b],Xb[b],
+                                              hybridW[indices[range_t(w0,w0+nb)]],vbias_cap);
+                if(streamed)
+                  AFQMCSys.propagate_streamed(Wb,Propg1,Spvn,Xb[b],vHS_block(nb),cond?cond+w0:nullptr);
+                else {
+                  base::get_vHS(Spvn,Xb[b],vHSb[b]);
+                  AFQMCSys.propagate(Wb,Propg1,vHSb[b],cond?cond+w0:nullptr);
+                }
+                for(int nw=0; nw<nb; nw++) {
+                  Wdb[nw][5] = Wdb[nw][4];
+                  Wdb[nw][6] = Wdb[nw][2];
+                  Wdb[nw][7] = Wdb[nw][3];
+                }
+                AFQMCSys.calculate_overlaps(Wb,Wdb);
+                Timers[Timer_taskB]->thread_stop();
+                add_work(Timer_taskB, base::vHS_cost(Spvn,nb) + base::propagate_cost(NMO,NAEA,nb) +
+                                      base::overlap_cost(NMO,NAEA,nb));
+              }
+
+            }
+          }
         }
-      Timers[Timer_X]->stop();
+        Timers[Timer_pipeline]->stop();
+
+      } else {
 
-      // 3. calculate vHS
-      // vHS(i,k,nw) = sum_n Spvn(i,k,n) * X(n,nw) 
-      Timers[Timer_vHS]->start();
-      base::get_vHS(Spvn,X,vHS);      
-      Timers[Timer_vHS]->stop();
+        // 1. calculate density matrix and bias potential 
 
-      // 4. propagate walker
-      // W(new) = Propg1 * exp(vHS) * Propg1 * W(old)
-      Timers[Timer_Propg]->start();
-      AFQMCSys.propagate(W,Propg1,vHS);
-      Timers[Timer_Propg]->stop();
+        if(transposed_Spvn) {
+
+          Timers[Timer_DMc]->start();
+          AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
+          if(planar) to_planar(Gc,Gp);
+          Timers[Timer_DMc]->stop();
+          add_work(Timer_DMc,cost_DMc);
+
+          Timers[Timer_vbias]->start();
+          if(planar)
+            base::get_vbias(SpvnT,Gp,vbias_p,true);
+          else
+            base::get_vbias(SpvnT,Gc,vbias,true);  
+          Timers[Timer_vbias]->stop();
+          add_work(Timer_vbias,cost_vbias);
+  
+        } else {
+
+          Timers[Timer_DM]->start();
+          AFQMCSys.calculate_mixed_density_matrix(W,W_data,G,false); 
+          if(planar) to_planar(G,Gp);
+          Timers[Timer_DM]->stop();
+          add_work(Timer_DM,cost_DM);
+
+          Timers[Timer_vbias]->start();
+          if(planar)
+            base::get_vbias(Spvn,Gp,vbias_p,false);
+          else
+            base::get_vbias(Spvn,G,vbias,false);
+          Timers[Timer_vbias]->stop();
+          add_work(Timer_vbias,cost_vbias);
+
+        } 
+
+        // 2. calculate X and weight
+        //  X(chol,nw) = rand + i*vbias(chol,nw)
+        Timers[Timer_X]->start();
+        if(planar)
+          base::sample_auxiliary_fields(random_th,walker_offset,step_tot,vbias_p,X_p,hybridW,vbias_cap);
+        else
+          base::sample_auxiliary_fields(random_th,walker_offset,step_tot,vbias,X,hybridW,vbias_cap);
+        Timers[Timer_X]->stop();
+
+        if(streamed) {
+
+          // 3-4. vHS in blocks of walkers, each consumed by the propagation of the block
+          Timers[Timer_Propg]->start();
+          AFQMCSys.propagate_streamed(W,Propg1,Spvn,X,vHS_block(nwalk),cond);
+          Timers[Timer_Propg]->stop();
+          add_work(Timer_Propg,cost_vHS+cost_Propg);
+
+        } else {
+
+          // 3. calculate vHS
+          // vHS(i,k,nw) = sum_n Spvn(i,k,n) * X(n,nw) 
+          Timers[Timer_vHS]->start();
+          if(planar)
+            base::get_vHS(Spvn,X_p,vHS_p);
+          else
+            base::get_vHS(Spvn,X,vHS);      
+          Timers[Timer_vHS]->stop();
+          add_work(Timer_vHS,cost_vHS);
+
+          // 4. propagate walker
+          // W(new) = Propg1 * exp(vHS) * Propg1 * W(old)
+          Timers[Timer_Propg]->start();
+          if(planar)
+            AFQMCSys.propagate(W,Propg1,vHS_p,cond);
+          else
+            AFQMCSys.propagate(W,Propg1,vHS,cond);
+          Timers[Timer_Propg]->stop();
+          add_work(Timer_Propg,cost_Propg);
+
+        }
+
+        // 5. update overlaps
+        Timers[Timer_extra]->start();
+        for(int nw=0; nw<nwalk; nw++) {
+          W_data[nw][5] = W_data[nw][4];
+          W_data[nw][6] = W_data[nw][2];
+          W_data[nw][7] = W_data[nw][3];
+        }
+        Timers[Timer_extra]->stop();
+        Timers[Timer_ovlp]->start();
+        AFQMCSys.calculate_overlaps(W,W_data);
+        Timers[Timer_ovlp]->stop();
+        add_work(Timer_ovlp,cost_ovlp);
 
-      // 5. update overlaps
-      Timers[Timer_extra]->start();
-      for(int nw=0; nw<nwalk; nw++) {
-        W_data[nw][5] = W_data[nw][4];
-        W_data[nw][6] = W_data[nw][2];
-        W_data[nw][7] = W_data[nw][3];
       }
-      Timers[Timer_extra]->stop();
-      Timers[Timer_ovlp]->start();
-      AFQMCSys.calculate_overlaps(W,W_data);
-      Timers[Timer_ovlp]->stop();
 
       // 6. adjust weights and walker data      
       Timers[Timer_extra]->start();
@@ -327,13 +817,29 @@ int main(int argc, char **argv)
       Eshift = et/nwalk;
       Timers[Timer_extra]->stop();
 
-      if(step_tot > 0 && step_tot%northo == 0) {
+      nwalk_substeps += nwalk;
+      if(adaptive_ortho) {
+        // only walkers that lost conditioning, or reached the maximum interval
+        ortho_list.clear();
+        for(int nw=0; nw<nwalk; nw++)
+          if(++since_ortho[nw] >= northo || ortho_cond[nw] > ortho_threshold) {
+            ortho_list.push_back(nw);
+            since_ortho[nw] = 0;
+          }
+        if(!ortho_list.empty()) {
+          Timers[Timer_ortho]->start();
+          AFQMCSys.orthogonalize(W,W_data,ortho_list,ortho);
+          Timers[Timer_ortho]->stop();
+          add_work(Timer_ortho,base::orthogonalize_cost(NMO,NAEA,ortho_list.size(),ortho));
+          northo_walkers += ortho_list.size();
+        }
+      } else if(step_tot > 0 && step_tot%northo == 0) {
         Timers[Timer_ortho]->start();
-        AFQMCSys.orthogonalize(W);
+        // also updates the overlaps in W_data
+        AFQMCSys.orthogonalize(W,W_data,ortho);
         Timers[Timer_ortho]->stop();
-        Timers[Timer_ovlp]->start();
-        AFQMCSys.calculate_overlaps(W,W_data);
-        Timers[Timer_ovlp]->stop();
+        add_work(Timer_ortho,cost_ortho);
+        northo_walkers += nwalk;
       }
        
     }
@@ -343,18 +849,52 @@ int main(int argc, char **argv)
     Eav = AFQMCSys.calculate_energy(W_data,Gc,haj,Vakbl);
     std::cout<<step <<"   " <<Eav <<"\n";
     Timers[Timer_eloc]->stop();
+    add_work(Timer_eloc,cost_eloc);
+
+    // the walkers are copied and written while the next step runs
+    if(checkpoint) {
+      Timers[Timer_checkpoint]->start();
+      checkpoint->write(step+1,step_tot,random_th.get_seed(),walker_offset,Eshift,W,W_data,
+                        since_ortho,ortho_cond);
+      Timers[Timer_checkpoint]->stop();
+    }
 
     // Branching in real code would happen here!!!
   
   }    
+  if(checkpoint) {
+    Timers[Timer_checkpoint]->start();
+    if(!checkpoint->wait())
+      std::cerr<<" Error writing checkpoint file: " <<checkpoint->name() <<std::endl;
+    Timers[Timer_checkpoint]->stop();
+  }
   Timers[Timer_Total]->stop();
 
   std::cout<<"\n";
   std::cout<<"***********************************************************\n";
   std::cout<<"                   Finished Calculation                    \n";   
   std::cout<<"***********************************************************\n\n";
+
+  if(northo_walkers > 0)
+    std::cout<<"  Orthogonalizations: " <<northo_walkers <<" walkers, average interval: "
+             <<double(nwalk_substeps)/northo_walkers <<" substeps\n";
+  std::cout<<"  Peak scratch memory (MB): " <<ScratchArena::total_peak()/1024.0/1024.0
+           <<" in " <<ScratchArena::num_arenas() <<" threads\n";
+  std::cout<<"  Large arrays (MB): " <<numa_large_bytes()/1024.0/1024.0
+           <<", on explicit huge pages: " <<numa_hugetlb_bytes()/1024.0/1024.0 <<"\n\n";
   
   TimerManager.print();
 
+  if(!timer_file.empty()) {
+    std::ofstream out(timer_file.c_str());
+    bool csv = timer_file.size() > 4 && timer_file.compare(timer_file.size()-4,4,".csv") == 0;
+    if(csv)
+      TimerManager.write_csv(out);
+    else
+      TimerManager.write_json(out);
+    if(!out)
+      std::cerr<<" Error writing timer file: " <<timer_file <<std::endl;
+  }
+
   return 0;
 }
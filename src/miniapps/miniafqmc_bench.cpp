@@ -0,0 +1,399 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file miniafqmc_bench.cpp
+    @brief Micro-benchmarks of the AFQMC kernels on synthetic data
+
+    Each kernel is timed on random matrices over a sweep of NMO, NAEA, nwalk
+    and densities of the sparse operands. Every case is run nwarm times before
+    nrep timed repetitions, and the median and percentiles of the repetitions
+    are reported together with the rate from the analytic flop counts
+    of kernel_costs.hpp.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+#include <Configuration.h>
+#include <getopt.h>
+
+#include "Matrix/MatrixOperator.hpp"
+#include "Matrix/PlanarMatrix.hpp"
+#include "AFQMC/afqmc_sys.hpp"
+#include "AFQMC/rotate.hpp"
+#include "AFQMC/vHS.hpp"
+#include "AFQMC/vbias.hpp"
+#include "AFQMC/kernel_costs.hpp"
+#include "Utilities/Clock.h"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("miniafqmc_bench - micro-benchmarks of the AFQMC kernels\n");
+  printf("\n");
+  printf("Options (lists are comma separated, all combinations are run):\n");
+  printf("-k                Kernels: csrmm_N, csrmm_T, csrmm_N_planar, csrmm_T_planar, dm, overlap, expM, dm_fixed,\n"
+         "                  overlap_fixed, expM_fixed, energy, halfrotate, ortho, ortho_cholqr2, ortho_mgs or all (default: all)\n"
+         "                  The _fixed kernels are specialized for NAEA, see AFQMC/fixed_size_kernels.hpp\n");
+  printf("-n                List of NMO (default: 64,128)\n");
+  printf("-e                List of NAEA, values larger than NMO are skipped (default: 16,32)\n");
+  printf("-w                List of number of walkers (default: 16)\n");
+  printf("-d                List of densities of the sparse matrices Spvn and Vakbl (default: 0.1)\n");
+  printf("-c                Number of Cholesky vectors per orbital, nchol = c*NMO (default: 4)\n");
+  printf("-m                Storage format of the sparse matrices: csr, sell or dense (default: csr)\n");
+  printf("-T                Walker tile of the sparse products, 0 for automatic (from the L2 size), -1 for no tiling (default: 0)\n");
+  printf("-u                Number of warmup repetitions (default: 3)\n");
+  printf("-r                Number of timed repetitions (default: 20)\n");
+  printf("-s                Random seed (default: 11)\n");
+}
+
+template<class T>
+std::vector<T> parse_list(const std::string& s)
+{
+  std::vector<T> v;
+  std::stringstream ss(s);
+  std::string item;
+  while(std::getline(ss,item,','))
+    if(!item.empty()) {
+      std::stringstream is(item);
+      T x;
+      is >> x;
+      v.push_back(x);
+    }
+  return v;
+}
+
+struct bench_stats
+{
+  double min, p10, median, p90, max;
+};
+
+/**
+ * Runs setup() then f(), nwarm times without timing and nrep times timing only f().
+ * Returns statistics of the timings, in seconds.
+ */
+template<class Setup, class Kernel>
+bench_stats run_bench(Setup&& setup, Kernel&& f, int nwarm, int nrep)
+{
+  for(int i=0; i<nwarm; i++) {
+    setup();
+    f();
+  }
+  std::vector<double> t(std::max(1,nrep));
+  for(size_t i=0; i<t.size(); i++) {
+    setup();
+    double t0 = cpu_clock();
+    f();
+    t[i] = cpu_clock()-t0;
+  }
+  std::sort(t.begin(),t.end());
+  auto pct = [&](double p) { return t[std::min(t.size()-1,static_cast<size_t>(p*(t.size()-1)+0.5))]; };
+  return bench_stats{t.front(),pct(0.1),pct(0.5),pct(0.9),t.back()};
+}
+
+template<class Kernel>
+bench_stats run_bench(Kernel&& f, int nwarm, int nrep)
+{
+  return run_bench([](){},std::forward<Kernel>(f),nwarm,nrep);
+}
+
+// random complex number with real and imaginary parts in [-scale,scale)
+inline ComplexType random_complex(std::mt19937& gen, double scale=1.0)
+{
+  std::uniform_real_distribution<double> u(-scale,scale);
+  double re = u(gen);
+  return ComplexType(re,u(gen));
+}
+
+template<class MultiArray>
+void fill_random(MultiArray& A, std::mt19937& gen, double scale=1.0)
+{
+  for(auto p=A.data(), pe=A.data()+A.num_elements(); p!=pe; ++p)
+    *p = random_complex(gen,scale);
+}
+
+/// random nr x nc CSR matrix with a fraction density of non-zero elements (at least one)
+template<class SpMat>
+void random_sparse(SpMat& A, int nr, int nc, double density, std::mt19937& gen)
+{
+  A.setDims(nr,nc);
+  unsigned long ntot = static_cast<unsigned long>(nr)*nc;
+  A.reserve(static_cast<unsigned long>(density*ntot*1.1)+1);
+  // positions of consecutive non-zeros are separated by geometrically distributed gaps
+  std::geometric_distribution<unsigned long> gap(std::min(1.0,std::max(density,1e-12)));
+  unsigned long n = gap(gen);
+  if(n >= ntot) n = 0;
+  for(; n<ntot; n += 1+gap(gen))
+    A.add(static_cast<int>(n/nc),static_cast<int>(n%nc),random_complex(gen));
+  A.compress();
+}
+
+void print_header()
+{
+  std::cout<<std::left <<std::setw(15) <<"# kernel" <<std::right
+           <<std::setw(6) <<"NMO" <<std::setw(6) <<"NAEA" <<std::setw(7) <<"nwalk"
+           <<std::setw(7) <<"nchol" <<std::setw(12) <<"nnz"
+           <<std::setw(12) <<"min(ms)" <<std::setw(12) <<"p10(ms)" <<std::setw(12) <<"median(ms)"
+           <<std::setw(12) <<"p90(ms)" <<std::setw(12) <<"max(ms)"
+           <<std::setw(10) <<"GFLOP/s" <<std::setw(10) <<"GB/s" <<std::endl;
+}
+
+void print_result(const std::string& kernel, int NMO, int NAEA, int nwalk, int nchol, unsigned long nnz,
+                  const bench_stats& s, const base::kernel_cost& c)
+{
+  std::cout<<std::left <<std::setw(15) <<kernel <<std::right
+           <<std::setw(6) <<NMO <<std::setw(6) <<NAEA <<std::setw(7) <<nwalk
+           <<std::setw(7) <<nchol <<std::setw(12) <<nnz <<std::fixed <<std::setprecision(4)
+           <<std::setw(12) <<s.min*1e3 <<std::setw(12) <<s.p10*1e3 <<std::setw(12) <<s.median*1e3
+           <<std::setw(12) <<s.p90*1e3 <<std::setw(12) <<s.max*1e3 <<std::setprecision(3)
+           <<std::setw(10) <<c.flops/s.median*1e-9 <<std::setw(10) <<c.bytes/s.median*1e-9
+           <<std::endl;
+  std::cout.unsetf(std::ios::fixed);
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  std::vector<std::string> all_kernels{"csrmm_N","csrmm_T","csrmm_N_planar","csrmm_T_planar","dm","overlap","expM","dm_fixed","overlap_fixed","expM_fixed","energy","halfrotate","ortho",
+                                       "ortho_cholqr2","ortho_mgs"};
+  std::vector<std::string> kernels(all_kernels);
+  std::vector<int> NMO_list{64,128};
+  std::vector<int> NAEA_list{16,32};
+  std::vector<int> nwalk_list{16};
+  std::vector<double> density_list{0.1};
+  int chol_factor = 4;
+  matrix_storage fmt = storage_csr;
+  int nwarm = 3;
+  int nrep = 20;
+  int walker_tile = 0;
+  int iseed = 11;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hk:n:e:w:d:c:m:u:r:s:T:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'k':
+      if(std::string(optarg) != "all")
+        kernels = parse_list<std::string>(optarg);
+      break;
+    case 'n':
+      NMO_list = parse_list<int>(optarg);
+      break;
+    case 'e':
+      NAEA_list = parse_list<int>(optarg);
+      break;
+    case 'w':
+      nwalk_list = parse_list<int>(optarg);
+      break;
+    case 'd':
+      density_list = parse_list<double>(optarg);
+      break;
+    case 'c':
+      chol_factor = atoi(optarg);
+      break;
+    case 'm':
+      if(!parse_storage(std::string(optarg),fmt) || fmt == storage_auto) {
+        std::cerr<<" Error: Unknown storage format: " <<optarg <<std::endl;
+        return 1;
+      }
+      break;
+    case 'u':
+      nwarm = atoi(optarg);
+      break;
+    case 'r':
+      nrep = atoi(optarg);
+      break;
+    case 's':
+      iseed = atoi(optarg);
+      break;
+    case 'T':
+      walker_tile = atoi(optarg);
+      break;
+    }
+  }
+  for(auto& k: kernels)
+    if(std::find(all_kernels.begin(),all_kernels.end(),k) == all_kernels.end()) {
+      std::cerr<<" Error: Unknown kernel: " <<k <<std::endl;
+      return 1;
+    }
+  auto run = [&](const std::string& k) { return std::find(kernels.begin(),kernels.end(),k) != kernels.end(); };
+
+  std::mt19937 gen(iseed);
+
+  std::cout<<"# threads: " <<omp_get_max_threads() <<"  storage: " <<storage_name(fmt)
+           <<"  warmup: " <<nwarm <<"  repetitions: " <<nrep <<"\n";
+  print_header();
+
+  for(int NMO: NMO_list)
+  for(int NAEA: NAEA_list) {
+    if(NAEA > NMO) continue;
+    int nchol = chol_factor*NMO;
+
+    base::afqmc_sys sys(NMO,NAEA);
+    sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
+    sys.trialwfn_beta.resize(extents[NMO][NAEA]);
+    fill_random(sys.trialwfn_alpha,gen);
+    fill_random(sys.trialwfn_beta,gen);
+
+    for(int nwalk: nwalk_list) {
+
+      WalkerContainer W(extents[nwalk][2][NMO][NAEA]);
+      ComplexMatrix W_data(extents[nwalk][8]);
+      fill_random(W,gen);
+      for(int n=0; n<nwalk; n++) W_data[n][1] = ComplexType(1.0);
+
+      // generic BLAS/LAPACK kernels, then those specialized for NAEA if available
+      for(bool fixed: {false, true}) {
+        if(sys.use_fixed_size_kernels(fixed) != fixed) continue;
+        std::string sfx = fixed?"_fixed":"";
+
+        if(run("dm"+sfx)) {
+          ComplexMatrix Gc(extents[2*NMO*NAEA][nwalk]);
+          auto s = run_bench([&]() { sys.calculate_mixed_density_matrix(W,W_data,Gc,true); },nwarm,nrep);
+          print_result("dm"+sfx,NMO,NAEA,nwalk,nchol,0,s,base::mixed_density_matrix_cost(NMO,NAEA,nwalk,true));
+        }
+
+        if(run("overlap"+sfx)) {
+          auto s = run_bench([&]() { sys.calculate_overlaps(W,W_data); },nwarm,nrep);
+          print_result("overlap"+sfx,NMO,NAEA,nwalk,nchol,0,s,base::overlap_cost(NMO,NAEA,nwalk));
+        }
+      }
+      sys.use_fixed_size_kernels(false);
+
+      // ortho is the LQ path, the walkers are re-randomized so that every method
+      // starts from non-orthogonal determinants
+      for(auto m: {base::ortho_lq, base::ortho_cholqr2, base::ortho_mgs}) {
+        std::string name = (m == base::ortho_lq) ? std::string("ortho") : "ortho_"+base::ortho_name(m);
+        if(!run(name)) continue;
+        fill_random(W,gen);
+        ComplexMatrix logdet(extents[nwalk][2]);
+        auto s = run_bench([&]() { sys.orthogonalize(W,logdet.data(),m); },nwarm,nrep);
+        print_result(name,NMO,NAEA,nwalk,nchol,0,s,base::orthogonalize_cost(NMO,NAEA,nwalk,m));
+      }
+
+      // one walker, repeated nwalk times
+      if(run("expM")) {
+        ComplexMatrix V(extents[NMO][NMO]);
+        ComplexMatrix S(extents[NMO][NAEA]), T1(extents[NMO][NAEA]), T2(extents[NMO][NAEA]);
+        fill_random(V,gen,1.0/NMO);
+        fill_random(S,gen);
+        auto s = run_bench([&]() {
+                             for(int n=0; n<nwalk; n++)
+                               base::apply_expM(V,S,T1,T2,6);
+                           },nwarm,nrep);
+        print_result("expM",NMO,NAEA,nwalk,nchol,0,s,double(nwalk)*base::apply_expM_cost(NMO,NAEA,6));
+      }
+
+      auto fixed_kernels = base::get_fixed_size_kernels<ComplexType>(NMO,NAEA);
+      if(run("expM_fixed") && fixed_kernels) {
+        ComplexMatrix V(extents[NMO][NMO]);
+        ComplexMatrix S(extents[NMO][NAEA]), T1(extents[NMO][NAEA]), T2(extents[NMO][NAEA]);
+        fill_random(V,gen,1.0/NMO);
+        fill_random(S,gen);
+        auto s = run_bench([&]() {
+                             for(int n=0; n<nwalk; n++)
+                               fixed_kernels->expM(NMO,V.origin(),S.origin(),T1.origin(),T2.origin(),6);
+                           },nwarm,nrep);
+        print_result("expM_fixed",NMO,NAEA,nwalk,nchol,0,s,double(nwalk)*base::apply_expM_cost(NMO,NAEA,6));
+      }
+
+      for(double density: density_list) {
+
+        if(run("csrmm_N") || run("csrmm_T") || run("csrmm_N_planar") || run("csrmm_T_planar")) {
+          MatrixOperator<ComplexType> Spvn;
+          random_sparse(Spvn.csr(),NMO*NMO,nchol,density,gen);
+          Spvn.set_storage(fmt);
+          Spvn.set_walker_tile(walker_tile);
+          if(run("csrmm_N")) {
+            ComplexMatrix X(extents[nchol][nwalk]), vHS(extents[NMO*NMO][nwalk]);
+            fill_random(X,gen);
+            auto s = run_bench([&]() { base::get_vHS(Spvn,X,vHS); },nwarm,nrep);
+            print_result("csrmm_N",NMO,NAEA,nwalk,nchol,Spvn.size(),s,base::vHS_cost(Spvn,nwalk));
+          }
+          if(run("csrmm_T")) {
+            ComplexMatrix G(extents[2*NMO*NMO][nwalk]), vbias(extents[nchol][nwalk]);
+            fill_random(G,gen);
+            auto s = run_bench([&]() { base::get_vbias(Spvn,G,vbias,false); },nwarm,nrep);
+            print_result("csrmm_T",NMO,NAEA,nwalk,nchol,Spvn.size(),s,base::vbias_cost(Spvn,nwalk,false));
+          }
+          // same products with split real/imaginary storage of the walker matrices
+          if(run("csrmm_N_planar")) {
+            ComplexMatrix X(extents[nchol][nwalk]);
+            PlanarMatrix<RealType> Xp(nchol,nwalk), vHSp(NMO*NMO,nwalk);
+            fill_random(X,gen);
+            to_planar(X,Xp);
+            auto s = run_bench([&]() { base::get_vHS(Spvn,Xp,vHSp); },nwarm,nrep);
+            print_result("csrmm_N_planar",NMO,NAEA,nwalk,nchol,Spvn.size(),s,base::vHS_cost(Spvn,nwalk));
+          }
+          if(run("csrmm_T_planar")) {
+            ComplexMatrix G(extents[2*NMO*NMO][nwalk]);
+            PlanarMatrix<RealType> Gp(2*NMO*NMO,nwalk), vbiasp(nchol,nwalk);
+            fill_random(G,gen);
+            to_planar(G,Gp);
+            auto s = run_bench([&]() { base::get_vbias(Spvn,Gp,vbiasp,false); },nwarm,nrep);
+            print_result("csrmm_T_planar",NMO,NAEA,nwalk,nchol,Spvn.size(),s,base::vbias_cost(Spvn,nwalk,false));
+          }
+        }
+
+        if(run("energy")) {
+          int NAK = 2*NMO*NAEA;
+          MatrixOperator<ComplexType> Vakbl;
+          random_sparse(Vakbl.csr(),NAK,NAK,density,gen);
+          Vakbl.set_storage(fmt);
+          Vakbl.set_walker_tile(walker_tile);
+          ComplexMatrix Gc(extents[NAK][nwalk]), haj(extents[2*NAEA][NMO]);
+          fill_random(Gc,gen);
+          fill_random(haj,gen);
+          auto s = run_bench([&]() { sys.calculate_energy(W_data,Gc,haj,Vakbl); },nwarm,nrep);
+          print_result("energy",NMO,NAEA,nwalk,nchol,Vakbl.size(),s,base::energy_cost(Vakbl,nwalk));
+        }
+
+        // halfrotate_cholesky transposes its input, a fresh copy is made before every call
+        if(run("halfrotate") && nwalk == nwalk_list.front()) {
+          SparseMatrix<ComplexType> Spvn0, Spvn, SpvnT;
+          random_sparse(Spvn0,NMO*NMO,nchol,density,gen);
+          auto copy = [&]() {
+            Spvn.setDims(Spvn0.rows(),Spvn0.cols());
+            Spvn.reserve(Spvn0.size());
+            for(int i=0; i<Spvn0.rows(); i++)
+              for(int p=*Spvn0.pntrb(i); p<*Spvn0.pntre(i); p++)
+                Spvn.add(i,*Spvn0.indx(p),*Spvn0.val(p));
+            Spvn.compress();
+            SpvnT.clear();
+          };
+          auto s = run_bench(copy,[&]() { base::halfrotate_cholesky(sys.trialwfn_alpha,sys.trialwfn_beta,Spvn,SpvnT); },nwarm,nrep);
+          // 2 dense NAEA x NMO x NMO products per Cholesky vector
+          base::kernel_cost c = double(2*nchol)*base::gemm_cost(NAEA,NMO,NMO);
+          print_result("halfrotate",NMO,NAEA,0,nchol,Spvn0.size(),s,c);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file rewrite_hamiltonian.cpp
+    @brief Rewrites an afqmc.h5 file with chunked/compressed datasets
+ */
+#include <iostream>
+#include <string>
+
+#include <Configuration.h>
+#include <getopt.h>
+#include "io/hdf_archive.h"
+
+#include "Matrix/SparseMatrix.hpp"
+#include "AFQMC/afqmc_sys.hpp"
+#include "Matrix/initialize_serial.hpp"
+#include "Matrix/hamiltonian_writer.hpp"
+#include "AFQMC/rotate.hpp"
+#include "Utilities/Clock.h"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("rewrite_hamiltonian - rewrites an afqmc.h5 file with chunked/compressed datasets\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("-i                Input file name (default: ./afqmc.h5)\n");
+  printf("-o                Output file name (required)\n");
+  printf("-b                Number of terms per Spvn block (default: 1048576)\n");
+  printf("-c                Number of elements per hdf5 chunk (default: 65536)\n");
+  printf("-z                Compression level, 0 (none) to 9 (default: 0)\n");
+  printf("-t                Also store the half-rotated Cholesky matrix, SpvnT (requires Spvn in memory)\n");
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  const double dt = 0.01;  // timestep assumed by miniafqmc, used to truncate SpvnT
+  std::string in_file = "afqmc.h5";
+  std::string out_file;
+  bool store_SpvnT = false;
+  afqmc::hamiltonian_layout layout;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hti:o:b:c:z:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'i':
+      in_file = std::string(optarg);
+      break;
+    case 'o':
+      out_file = std::string(optarg);
+      break;
+    case 'b':
+      layout.block_size = atol(optarg);
+      break;
+    case 'c':
+      layout.chunk_size = atol(optarg);
+      break;
+    case 'z':
+      layout.compression = atoi(optarg);
+      break;
+    case 't': store_SpvnT = true;
+      break;
+    }
+  }
+  if(out_file.empty() || out_file == in_file) {
+    print_help();
+    return 1;
+  }
+
+  hdf_archive in, out;
+  if(!in.open(in_file,H5F_ACC_RDONLY))
+    APP_ABORT("Error: problems opening hdf5 file. \n");
+  if(!out.create(out_file))
+    APP_ABORT("Error: problems creating hdf5 file. \n");
+
+  std::cout<<"  Rewriting " <<in_file <<" into " <<out_file <<"\n"
+           <<"    block size: " <<layout.block_size <<"\n"
+           <<"    chunk size: " <<layout.chunk_size <<"\n"
+           <<"    compression: " <<layout.compression <<std::endl;
+
+  double t0 = cpu_clock();
+  if(!afqmc::rewrite_hamiltonian(in,out,layout)) {
+    std::cerr<<" Error rewriting hamiltonian. " <<std::endl;
+    return 1;
+  }
+
+  if(store_SpvnT) {
+    base::afqmc_sys sys;
+    ComplexMatrix Propg1, haj;
+    SparseMatrix<ComplexType> Spvn, Vakbl, SpvnT;
+    if(!afqmc::Initialize(in,dt,sys,Propg1,Spvn,haj,Vakbl)) {
+      std::cerr<<" Error reading hamiltonian. " <<std::endl;
+      return 1;
+    }
+    Vakbl.clear();
+    base::halfrotate_cholesky(sys.trialwfn_alpha,sys.trialwfn_beta,Spvn,SpvnT);
+    if(!afqmc::write_SpvnT(out,SpvnT,dt,layout)) {
+      std::cerr<<" Error writing SpvnT. " <<std::endl;
+      return 1;
+    }
+  }
+  in.close();
+  out.close();
+
+  std::cout<<"  Done in " <<cpu_clock()-t0 <<" seconds. " <<std::endl;
+
+  return 0;
+}